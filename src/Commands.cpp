@@ -0,0 +1,233 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <endian.h>
+
+/**
+ * @brief One I (insert), D (delete) or S (search) command.
+ */
+struct Command {
+    char op;
+    int key;
+};
+
+/**
+ * @brief Reads commands from a file descriptor without allocating per command.
+ *          Regular files are memory mapped, pipes are read in 1 MiB chunks.
+ *
+ *          Text input has one command per line, "I 5", "D 5" or "S 5". Lines without a key are skipped.
+ *          Binary input starts with the 8 byte MAGIC and is followed by 5 byte records:
+ *          the op character and the key as a little-endian int32. The format is detected from the first bytes.
+ */
+class CommandReader {
+    int fd = -1;
+    const char* data = nullptr;
+    size_t pos = 0;
+    size_t len = 0;
+    bool eof = false;
+    bool binary = false;
+
+    void* mapped = nullptr;
+    size_t mappedSize = 0;
+    std::vector<char> chunk;
+
+    /**
+     * @brief Makes sure at least need bytes are buffered after pos, unless the input ends first.
+     *          Moves the unread bytes to the front of chunk and reads behind them.
+     *
+     * @param need
+     * @return true if need bytes are available.
+     */
+    bool ensure(size_t need) {
+        while(len - pos < need && !eof) {
+            size_t left = len - pos;
+            memmove(chunk.data(), data + pos, left);
+            if(chunk.size() < 2 * need)
+                chunk.resize(2 * need);
+            data = chunk.data();
+            pos = 0;
+            len = left;
+            ssize_t got = read(fd, chunk.data() + len, chunk.size() - len);
+            if(got <= 0)
+                eof = true;
+            else
+                len += got;
+        }
+        return len - pos >= need;
+    }
+
+    void detect() {
+        binary = ensure(sizeof(MAGIC) - 1) && memcmp(data + pos, MAGIC, sizeof(MAGIC) - 1) == 0;
+        if(binary)
+            pos += sizeof(MAGIC) - 1;
+    }
+
+    /**
+     * @brief Parses one text line [p, end) into c.
+     * @return true if it held an op and a key.
+     */
+    static bool parse(const char* p, const char* end, Command& c) {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        if(p == end)
+            return false;
+        c.op = *p++;
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        bool negative = p < end && *p == '-';
+        if(negative)
+            p++;
+        if(p == end || *p < '0' || *p > '9')
+            return false;
+        unsigned key = 0;
+        while(p < end && *p >= '0' && *p <= '9')
+            key = key * 10 + (*p++ - '0');
+        c.key = negative ? -(int) key : (int) key;
+        return true;
+    }
+
+    public:
+        static constexpr char MAGIC[] = "SGTCMD\x01\n";
+        static const int RECORD = 5;
+
+        /**
+         * @brief Reads commands from fd, which stays open.
+         *
+         * @param fd
+         */
+        CommandReader(int fd) : fd(fd) {
+            struct stat st;
+            if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                off_t offset = lseek(fd, 0, SEEK_CUR);
+                void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(p != MAP_FAILED) {
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+                    mapped = p;
+                    mappedSize = st.st_size;
+                    data = static_cast<const char*>(p);
+                    pos = offset > 0 ? offset : 0;
+                    len = st.st_size;
+                    eof = true;
+                }
+            }
+            if(!mapped) {
+                chunk.resize(1 << 20);
+                data = chunk.data();
+            }
+            detect();
+        }
+
+        /**
+         * @brief Reads commands from n bytes of memory, which must outlive the reader.
+         */
+        CommandReader(const char* memory, size_t n) : data(memory), len(n), eof(true) {
+            detect();
+        }
+
+        ~CommandReader() {
+            if(mapped)
+                munmap(mapped, mappedSize);
+        }
+
+        CommandReader(const CommandReader&) = delete;
+        CommandReader& operator=(const CommandReader&) = delete;
+
+        /**
+         * @brief Reads the next command.
+         *
+         * @param c receives the command.
+         * @return false at the end of the input.
+         */
+        bool next(Command& c) {
+            if(binary) {
+                if(!ensure(RECORD))
+                    return false;
+                uint32_t key;
+                c.op = data[pos];
+                memcpy(&key, data + pos + 1, 4);
+                c.key = (int) le32toh(key);
+                pos += RECORD;
+                return true;
+            }
+            while(true) {
+                const char* nl;
+                while(!(nl = pos < len ? static_cast<const char*>(memchr(data + pos, '\n', len - pos)) : nullptr) && !eof)
+                    ensure(len - pos + 1);
+                if(pos == len)
+                    return false;
+                const char* end = nl ? nl : data + len;
+                bool ok = parse(data + pos, end, c);
+                pos = end - data + (nl != nullptr);
+                if(ok)
+                    return true;
+            }
+        }
+};
+
+/**
+ * @brief Collects output in one large buffer and writes it to a file descriptor when full.
+ */
+class OutputBuffer {
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    public:
+        OutputBuffer(int fd, size_t size = 1 << 20) : fd(fd), buffer(size) {}
+
+        ~OutputBuffer() {
+            flush();
+        }
+
+        void put(const char* s, size_t n) {
+            if(used + n > buffer.size()) {
+                flush();
+                if(n > buffer.size()) {
+                    for(size_t done = 0; done < n;) {
+                        ssize_t w = write(fd, s + done, n - done);
+                        if(w <= 0)
+                            return;
+                        done += w;
+                    }
+                    return;
+                }
+            }
+            memcpy(buffer.data() + used, s, n);
+            used += n;
+        }
+
+        template<size_t N>
+        void put(const char (&s)[N]) {
+            put(s, N - 1);
+        }
+
+        /**
+         * @brief Writes out everything buffered. Call before writing to the same descriptor another way.
+         */
+        void flush() {
+            size_t done = 0;
+            while(done < used) {
+                ssize_t w = write(fd, buffer.data() + done, used - done);
+                if(w <= 0)
+                    break;
+                done += w;
+            }
+            used = 0;
+        }
+};
+
+/**
+ * @brief Writes c as a binary record, see CommandReader.
+ */
+inline void putRecord(OutputBuffer& out, const Command& c) {
+    char record[CommandReader::RECORD];
+    uint32_t key = htole32((uint32_t) c.key);
+    record[0] = c.op;
+    memcpy(record + 1, &key, 4);
+    out.put(record, sizeof(record));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Detects a comparator with its own three-way int compare(a, b) const, see three_way.
+ */
+template<typename Compare, typename A, typename B, typename = void>
+struct HasThreeWay : std::false_type {};
+
+template<typename Compare, typename A, typename B>
+struct HasThreeWay<Compare, A, B,
+    std::void_t<decltype(std::declval<const Compare&>().compare(std::declval<const A&>(), std::declval<const B&>()))>>
+    : std::true_type {};
+
+template<typename Compare>
+struct IsStdLess : std::false_type {};
+
+template<typename T>
+struct IsStdLess<std::less<T>> : std::true_type {};
+
+template<typename T>
+struct IsString : std::false_type {};
+
+template<typename Traits, typename Allocator>
+struct IsString<std::basic_string<char, Traits, Allocator>> : std::true_type {};
+
+template<typename Traits>
+struct IsString<std::basic_string_view<char, Traits>> : std::true_type {};
+
+/**
+ * @brief std::less on numbers, where testing less twice is one hardware compare. A search loop then does better
+ *          testing less directly than going through three_way, whose int result adds steps between loading a key
+ *          and choosing the next node.
+ */
+template<typename Compare, typename A, typename B>
+struct CheapLess : std::integral_constant<bool,
+    IsStdLess<Compare>::value && std::is_arithmetic<A>::value && std::is_arithmetic<B>::value> {};
+
+/**
+ * @brief Detects a transparent comparator, one that compares keys with other types (std::less<> does).
+ */
+template<typename Compare, typename = void>
+struct IsTransparent : std::false_type {};
+
+template<typename Compare>
+struct IsTransparent<Compare, std::void_t<typename Compare::is_transparent>> : std::true_type {};
+
+/**
+ * @brief Three-way comparison under the strict weak order of Compare: negative if a goes before b,
+ *          positive if b goes before a, 0 if they are equivalent. Lets a search test each key once
+ *          instead of once for less and once for equal.
+ *          A comparator can provide int compare(a, b) const, which is used as is. With std::less, numbers are
+ *          compared without branches and strings with one string_view::compare. Other comparators are called
+ *          twice when a goes not before b.
+ */
+template<typename Compare, typename A, typename B>
+int three_way(const Compare& comp, const A& a, const B& b) {
+    if constexpr(HasThreeWay<Compare, A, B>::value)
+        return comp.compare(a, b);
+    else if constexpr(IsStdLess<Compare>::value && std::is_arithmetic<A>::value && std::is_arithmetic<B>::value)
+        return (b < a) - (a < b);
+    else if constexpr(IsStdLess<Compare>::value && IsString<A>::value && IsString<B>::value)
+        return std::string_view(a).compare(std::string_view(b));
+    else
+        return comp(a, b) ? -1 : comp(b, a) ? 1 : 0;
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "Epoch.cpp"
+#include "Stats.cpp"
+
+/**
+ * @brief Scapegoat tree where search_key never takes a lock.
+ *          Writers are serialized by a mutex. They never change a node that a reader might be on:
+ *          a new leaf is published with one pointer store, and rebuilds and removals of inner nodes
+ *          build replacement nodes off to the side and publish them with one pointer store.
+ *          Replaced nodes are handed to Epoch and freed once no reader can still see them.
+ *
+ * @tparam K
+ * @tparam StatsPolicy NoStats, or ConcurrentStats since searches run on many threads.
+ */
+template<typename K, typename StatsPolicy = NoStats>
+class ConcurrentScapegoatTree {
+    struct Node {
+        const K key;
+        std::atomic<Node*> left {nullptr};
+        std::atomic<Node*> right {nullptr};
+
+        Node(const K& key) : key(key) {}
+    };
+
+    std::atomic<Node*> root {nullptr};
+    int size = 0;
+    int max_size = 0;
+    float alpha = 0.57;
+
+    StatsPolicy statistics;
+
+    std::mutex writer;
+
+    //reused by every rebuild, only touched by the writer
+    std::vector<Node*> scratch;
+    std::vector<Node*> path;
+
+    int h_alpha() {
+        return floor(log(size) / log(1/alpha));
+    }
+
+    static void destroyNode(void* node) {
+        delete static_cast<Node*>(node);
+    }
+
+    /**
+     * @brief Finds size of a node. Writer only.
+     *
+     * @param node
+     * @return int
+     */
+    int size_of(Node* node) {
+        int n = 0;
+        path.clear();
+        if(node)
+            path.push_back(node);
+        while(!path.empty()) {
+            Node* x = path.back();
+            path.pop_back();
+            n++;
+            if(Node* l = x->left.load(std::memory_order_relaxed))
+                path.push_back(l);
+            if(Node* r = x->right.load(std::memory_order_relaxed))
+                path.push_back(r);
+        }
+        return n;
+    }
+
+    /**
+     * @brief Appends the nodes of the subtree x to scratch in sorted order, without changing them.
+     *
+     * @param x root of the subtree.
+     */
+    void flatten(Node* x) {
+        path.clear();
+        while(x || !path.empty()) {
+            while(x) {
+                path.push_back(x);
+                x = x->left.load(std::memory_order_relaxed);
+            }
+            x = path.back();
+            path.pop_back();
+            scratch.push_back(x);
+            x = x->right.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Builds a perfectly balanced copy of the nodes scratch[0..n). The copies are not yet
+     *          visible to readers, so they can be linked with plain stores.
+     *
+     * @param n Number of nodes to build.
+     * @return Node* to the root of the copy.
+     */
+    Node* build(int n) {
+        struct Range {
+            int lo, hi;
+            std::atomic<Node*>* link;
+        };
+        Range stack[64];
+        int top = 0;
+        std::atomic<Node*> r {nullptr};
+        stack[top++] = {0, n, &r};
+        while(top > 0) {
+            Range range = stack[--top];
+            if(range.lo >= range.hi)
+                continue;
+            int mid = range.lo + (range.hi - range.lo) / 2;
+            Node* m = new Node(scratch[mid]->key);
+            range.link->store(m, std::memory_order_relaxed);
+            stack[top++] = {range.lo, mid, &m->left};
+            stack[top++] = {mid + 1, range.hi, &m->right};
+        }
+        return r.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Replaces the subtree at link with a balanced copy and retires the old nodes.
+     *
+     * @param link parent pointer (or root) of the subtree.
+     */
+    void rebuild(std::atomic<Node*>& link) {
+        long start = statistics.now();
+        scratch.clear();
+        flatten(link.load(std::memory_order_relaxed));
+        Node* copy = build(scratch.size());
+        link.store(copy, std::memory_order_release);
+        statistics.rebuild(scratch.size(), start);
+        for(Node* old : scratch)
+            Epoch::retire(old, destroyNode);
+    }
+
+    public:
+        ConcurrentScapegoatTree(float alpha = 0.57) {
+            this->alpha = alpha;
+        }
+
+        /**
+         * @brief Frees every node. No other thread may use the tree anymore.
+         */
+        ~ConcurrentScapegoatTree() {
+            scratch.clear();
+            flatten(root.load());
+            for(Node* node : scratch)
+                delete node;
+        }
+
+        /**
+         * @brief Inserts a key and rebuilds at a scapegoat if the new node is too deep.
+         *
+         * @param key
+         * @return int - 1 = success, -1 duplicate key.
+         */
+        int insert(const K& key) {
+            std::lock_guard<std::mutex> lock (writer);
+            std::vector<std::atomic<Node*>*> links; // links[d] points to the node at depth d
+            std::atomic<Node*>* link = &root;
+            while(Node* n = link->load(std::memory_order_relaxed)) {
+                if(key == n->key)
+                    return -1;
+                links.push_back(link);
+                link = key < n->key ? &n->left : &n->right;
+            }
+            Node* node = new Node(key);
+            link->store(node, std::memory_order_release);
+            size++;
+            max_size = std::max(max_size, size);
+            statistics.insert();
+
+            //check if too deep
+            if((int)links.size() > h_alpha()) {
+                Node* child = node;
+                int child_size = 1;
+                for(int d = links.size() - 1; d >= 0; d--) {
+                    Node* n = links[d]->load(std::memory_order_relaxed);
+                    Node* l = n->left.load(std::memory_order_relaxed);
+                    int sibling_size = size_of(l == child ? n->right.load(std::memory_order_relaxed) : l);
+                    int n_size = child_size + sibling_size + 1;
+                    if(!(child_size <= alpha * n_size && sibling_size <= alpha * n_size)) {
+                        rebuild(*links[d]);
+                        max_size = size;
+                        return 1;
+                    }
+                    child = n;
+                    child_size = n_size;
+                }
+            }
+            return 1;
+        }
+
+        /**
+         * @brief Removes a key. A node with two children is replaced by a copy holding its successor's key,
+         *          so readers never see a key change or a subtree lose a node under them.
+         *
+         * @param key
+         * @return int - 0 = fail, 1 = sucess.
+         */
+        int remove(const K& key) {
+            std::lock_guard<std::mutex> lock (writer);
+            std::atomic<Node*>* link = &root;
+            Node* n;
+            while((n = link->load(std::memory_order_relaxed)) && !(n->key == key))
+                link = key < n->key ? &n->left : &n->right;
+            if(n == nullptr)
+                return 0;
+
+            Node* l = n->left.load(std::memory_order_relaxed);
+            Node* r = n->right.load(std::memory_order_relaxed);
+            if(l == nullptr || r == nullptr) {
+                link->store(l ? l : r, std::memory_order_release);
+                Epoch::retire(n, destroyNode);
+            } else {
+                //copy n and the left spine from its right child down to the successor, leaving the
+                //successor out, and publish the copy with one store. Readers already inside n still
+                //see the old, unchanged nodes.
+                scratch.clear();
+                Node* succ = r;
+                while(Node* s = succ->left.load(std::memory_order_relaxed)) {
+                    scratch.push_back(succ);
+                    succ = s;
+                }
+                Node* copy = new Node(succ->key);
+                copy->left.store(l, std::memory_order_relaxed);
+                std::atomic<Node*>* tail = &copy->right;
+                for(Node* p : scratch) {
+                    Node* c = new Node(p->key);
+                    c->right.store(p->right.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    tail->store(c, std::memory_order_relaxed);
+                    tail = &c->left;
+                }
+                tail->store(succ->right.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                link->store(copy, std::memory_order_release);
+                Epoch::retire(n, destroyNode);
+                Epoch::retire(succ, destroyNode);
+                for(Node* p : scratch)
+                    Epoch::retire(p, destroyNode);
+            }
+            size--;
+            statistics.remove();
+
+            if(size < alpha * max_size) {
+                //rebuild tree
+                rebuild(root);
+                max_size = size;
+            }
+            return 1;
+        }
+
+        /**
+         * @brief Searches for the key without locking. Safe while another thread writes.
+         *
+         * @param key
+         * @return true if the key was found.
+         */
+        bool search_key(const K& key) {
+            Epoch::Guard guard;
+            int comps = 0;
+            Node* tmp = root.load(std::memory_order_acquire);
+            while(tmp && !(tmp->key == key)) {
+                comps += 2;
+                if(key < tmp->key)
+                    tmp = tmp->left.load(std::memory_order_acquire);
+                else
+                    tmp = tmp->right.load(std::memory_order_acquire);
+            }
+            statistics.search(comps);
+            return tmp != nullptr;
+        }
+
+        int getSize() {
+            std::lock_guard<std::mutex> lock (writer);
+            return size;
+        }
+
+        /**
+         * @brief Snapshot of the counters kept by StatsPolicy, plus size and height.
+         *          Takes the writer lock to walk the tree for the height.
+         *
+         * @return Stats
+         */
+        Stats stats() {
+            std::lock_guard<std::mutex> lock (writer);
+            Stats s;
+            statistics.collect(s);
+            s.size = size;
+            std::vector<std::pair<Node*, int>> stack;
+            if(Node* r = root.load(std::memory_order_relaxed))
+                stack.push_back({r, 1});
+            while(!stack.empty()) {
+                auto [node, depth] = stack.back();
+                stack.pop_back();
+                s.height = std::max(s.height, depth);
+                if(Node* l = node->left.load(std::memory_order_relaxed))
+                    stack.push_back({l, depth + 1});
+                if(Node* r = node->right.load(std::memory_order_relaxed))
+                    stack.push_back({r, depth + 1});
+            }
+            return s;
+        }
+};
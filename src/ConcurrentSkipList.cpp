@@ -0,0 +1,347 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <cstdint>
+
+#include "Epoch.cpp"
+#include "Stats.cpp"
+
+/**
+ * @brief Lock-free skiplist for many threads at once.
+ *          Searches never block, insert and remove link and unlink nodes with CAS.
+ *          A node is removed by marking the low bit of its forward pointers, top level first;
+ *          the mark on level 0 is the moment the key is gone. Marked nodes are unlinked by whichever
+ *          thread passes them and handed to Epoch for reclamation.
+ *
+ * @tparam K key, must be default constructible and comparable with <.
+ * @tparam T data.
+ * @tparam StatsPolicy NoStats, or ConcurrentStats since every operation runs on many threads.
+ */
+template <typename K, typename T, typename StatsPolicy = NoStats>
+class ConcurrentSkiplist {
+
+    std::atomic<int> size {0};
+    std::atomic<int> MAXLEVEL {0};
+    int levelCap;
+    float probability = 0.5;
+    int levelBits = 0;
+    double invLogProbability = 0;
+    uint64_t seed;
+
+    StatsPolicy statistics;
+
+    /**
+     * @brief A node and its tower share one allocation, like in Skiplist.
+     *          The tower holds marked pointers, the low bit set means the node is being removed.
+     *          refs counts the inserter and the remover, the last one to finish retires the node.
+     */
+    struct alignas(void*) Node {
+        K key;
+        T data;
+        int level = 0;
+        std::atomic<int> refs {2};
+
+        std::atomic<uintptr_t>* next() {
+            return reinterpret_cast<std::atomic<uintptr_t>*>(this + 1);
+        }
+    };
+
+    Node* head;
+
+    static Node* pointer(uintptr_t p) {
+        return reinterpret_cast<Node*>(p & ~(uintptr_t) 1);
+    }
+
+    static bool marked(uintptr_t p) {
+        return p & 1;
+    }
+
+    /**
+     * @brief Create a Node object.
+     *
+     * @param level level of created node.
+     * @return Node*
+     */
+    Node* createNode(int level) {
+        void* memory = ::operator new(sizeof(Node) + (level + 1) * sizeof(std::atomic<uintptr_t>));
+        Node* node = new (memory) Node();
+        node->level = level;
+        for(int i = 0; i <= level; i++)
+            new (&node->next()[i]) std::atomic<uintptr_t>(0);
+        return node;
+    }
+
+    static void destroyNode(void* p) {
+        Node* node = static_cast<Node*>(p);
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    /**
+     * @brief Drops one of the two references to a node. The last one hands it to Epoch.
+     */
+    static void release(Node* node) {
+        if(node->refs.fetch_sub(1) == 1)
+            Epoch::retire(node, destroyNode);
+    }
+
+    /**
+     * @brief xorshift64* on a per thread state, so threads never share generator state.
+     */
+    uint64_t nextRandom() {
+        thread_local uint64_t state = 0;
+        if(state == 0)
+            state = (seed ^ reinterpret_cast<uintptr_t>(&state)) | 1;
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    /**
+     * @brief Generates a random level for a node, same distribution as Skiplist::randomLevel.
+     */
+    int randomLevel() {
+        int level;
+        if(levelBits > 0) {
+            level = __builtin_ctzll(nextRandom() | (1ULL << 63)) / levelBits;
+        } else if(probability <= 0) {
+            level = 0;
+        } else if(probability >= 1) {
+            level = levelCap;
+        } else {
+            double u = ((nextRandom() >> 11) + 1) * 0x1.0p-53;
+            double l = log(u) * invLogProbability;
+            level = l < levelCap ? (int) l : levelCap;
+        }
+        return std::min(level, levelCap);
+    }
+
+    /**
+     * @brief Finds the predecessor and successor of key on every level up to MAXLEVEL,
+     *          unlinking the marked nodes it passes. Must be called inside an Epoch::Guard.
+     *
+     * @param key
+     * @param preds last node with a smaller key, per level.
+     * @param succs first unmarked node with a key not smaller than key, per level.
+     * @return true if succs[0] holds key.
+     */
+    bool find(const K& key, Node** preds, Node** succs) {
+        retry:
+        Node* pred = head;
+        for(int i = MAXLEVEL.load(); i >= 0; i--) {
+            Node* current = pointer(pred->next()[i].load());
+            while(current != nullptr) {
+                uintptr_t succ = current->next()[i].load();
+                if(marked(succ)) {
+                    uintptr_t expected = reinterpret_cast<uintptr_t>(current);
+                    if(!pred->next()[i].compare_exchange_strong(expected, succ & ~(uintptr_t) 1))
+                        goto retry;
+                    current = pointer(succ);
+                    continue;
+                }
+                if(!(current->key < key))
+                    break;
+                pred = current;
+                current = pointer(succ);
+            }
+            preds[i] = pred;
+            succs[i] = current;
+        }
+        return succs[0] != nullptr && succs[0]->key == key;
+    }
+
+    public:
+        /**
+         * @brief Construct a new Concurrent Skiplist.
+         *
+         * @param levelCap highest level a node can get, at most 63.
+         * @param probability chance of a node reaching the next level.
+         * @param seed mixed into every thread's level generator.
+         */
+        ConcurrentSkiplist(int levelCap, float probability=0.5, uint64_t seed=0x9E3779B97F4A7C15ULL) {
+            this->levelCap = std::min(levelCap, 63);
+            this->probability = probability;
+            this->seed = seed;
+            if(probability > 0 && probability < 1) {
+                int exponent;
+                if(frexp(probability, &exponent) == 0.5 && exponent <= 0)
+                    levelBits = 1 - exponent;
+                invLogProbability = 1 / log(probability);
+            }
+            head = createNode(this->levelCap);
+        }
+
+        /**
+         * @brief Frees the nodes still linked on level 0. No other thread may use the list anymore.
+         */
+        ~ConcurrentSkiplist() {
+            Node* current = head;
+            while(current != nullptr) {
+                Node* next = pointer(current->next()[0].load());
+                destroyNode(current);
+                current = next;
+            }
+        }
+
+        /**
+         * @brief Inserts key with data if the key is not in the list.
+         *          Unlike Skiplist::insert an existing key keeps its data, since readers may be copying it.
+         *
+         * @param key
+         * @param data
+         * @return int 0 = inserted, 1 = key already exists.
+         */
+        int insert(const K& key, const T& data) {
+            Epoch::Guard guard;
+            Node* preds[64];
+            Node* succs[64];
+            int level = randomLevel();
+            int max = MAXLEVEL.load();
+            while(max < level && !MAXLEVEL.compare_exchange_weak(max, level));
+
+            Node* node = nullptr;
+            while(true) {
+                if(find(key, preds, succs)) {
+                    if(node)
+                        destroyNode(node);
+                    return 1;
+                }
+                if(!node) {
+                    node = createNode(level);
+                    node->key = key;
+                    node->data = data;
+                }
+                for(int i = 0; i <= level; i++)
+                    node->next()[i].store(reinterpret_cast<uintptr_t>(succs[i]));
+                uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+                if(preds[0]->next()[0].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node)))
+                    break;
+            }
+            size++;
+            statistics.insert();
+
+            //link the upper levels, stopping if the node gets removed meanwhile.
+            for(int i = 1; i <= level; i++) {
+                while(true) {
+                    uintptr_t current = node->next()[i].load();
+                    if(marked(current))
+                        goto done;
+                    if(pointer(current) != succs[i] &&
+                        !node->next()[i].compare_exchange_strong(current, reinterpret_cast<uintptr_t>(succs[i])))
+                        continue;
+                    uintptr_t expected = reinterpret_cast<uintptr_t>(succs[i]);
+                    if(preds[i]->next()[i].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node)))
+                        break;
+                    find(key, preds, succs);
+                    if(succs[0] != node)
+                        goto done;
+                }
+            }
+            done:
+            //a remover may have finished while a level was being linked, make sure it is unlinked again.
+            if(marked(node->next()[0].load()))
+                find(key, preds, succs);
+            release(node);
+            return 0;
+        }
+
+        /**
+         * @brief Removes a key from the list.
+         *
+         * @param key
+         * @return true if this call removed the key.
+         * @return false if the key was not found or another thread removed it first.
+         */
+        bool remove(const K& key) {
+            Epoch::Guard guard;
+            Node* preds[64];
+            Node* succs[64];
+            if(!find(key, preds, succs))
+                return false;
+            Node* victim = succs[0];
+            for(int i = victim->level; i > 0; i--) {
+                uintptr_t succ = victim->next()[i].load();
+                while(!marked(succ))
+                    victim->next()[i].compare_exchange_weak(succ, succ | 1);
+            }
+            uintptr_t succ = victim->next()[0].load();
+            while(!marked(succ)) {
+                if(victim->next()[0].compare_exchange_strong(succ, succ | 1)) {
+                    size--;
+                    statistics.remove();
+                    find(key, preds, succs);
+                    release(victim);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief Searches the list for a key without writing to it.
+         *
+         * @param key
+         * @param data if not null, receives a copy of the key's data.
+         * @return true if the key was found.
+         */
+        bool search(const K& key, T* data = nullptr) {
+            Epoch::Guard guard;
+            int comps = 0;
+            Node* pred = head;
+            Node* current = nullptr;
+            for(int i = MAXLEVEL.load(); i >= 0; i--) {
+                current = pointer(pred->next()[i].load());
+                while(current != nullptr) {
+                    uintptr_t succ = current->next()[i].load();
+                    if(marked(succ)) {
+                        current = pointer(succ);
+                        continue;
+                    }
+                    comps++;
+                    if(!(current->key < key))
+                        break;
+                    pred = current;
+                    current = pointer(succ);
+                }
+            }
+            statistics.search(comps + 1);
+            if(current != nullptr && current->key == key) {
+                if(data)
+                    *data = current->data;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Get the size of the list. Only exact while no other thread is changing it.
+         * @return int
+         */
+        int getSize() {
+            return size.load();
+        }
+
+        /**
+         * @brief Snapshot of the counters kept by StatsPolicy, plus size, the highest level in use
+         *          and the level histogram of the unmarked nodes on level 0. Only exact while no other thread is writing.
+         *
+         * @return Stats
+         */
+        Stats stats() {
+            Epoch::Guard guard;
+            Stats s;
+            statistics.collect(s);
+            s.size = size.load();
+            s.levels.assign(levelCap + 1, 0);
+            for(Node* node = pointer(head->next()[0].load()); node != nullptr; node = pointer(node->next()[0].load())) {
+                if(marked(node->next()[0].load()))
+                    continue;
+                s.levels[node->level]++;
+                s.height = std::max(s.height, node->level + 1);
+            }
+            s.levels.resize(s.height);
+            return s;
+        }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <stdexcept>
+
+/**
+ * @brief Epoch based memory reclamation shared by the concurrent containers.
+ *          Readers and writers hold an Epoch::Guard while they touch shared nodes.
+ *          A node that has been unlinked is passed to retire() and is freed once every thread
+ *          that could still see it has left its guard, i.e. two epochs later.
+ */
+class Epoch {
+    static const int MAXTHREADS = 256;
+
+    // (epoch << 1) | active, one cache line per thread.
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> state {0};
+        std::atomic<bool> used {false};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* pointer;
+        void (*deleter)(void*);
+    };
+
+    /**
+     * @brief Per thread registration, retired pointers still waiting for their grace period.
+     *          Leftovers are handed to the global orphan list when the thread exits.
+     */
+    struct ThreadState {
+        int slot = -1;
+        int depth = 0;
+        std::vector<Retired> retired;
+
+        ThreadState() {
+            for(int i = 0; i < MAXTHREADS; i++) {
+                bool expected = false;
+                if(domain().slot[i].used.compare_exchange_strong(expected, true)) {
+                    slot = i;
+                    break;
+                }
+            }
+            if(slot < 0)
+                throw std::runtime_error("Epoch: too many threads");
+        }
+
+        ~ThreadState() {
+            Domain& d = domain();
+            {
+                std::lock_guard<std::mutex> lock (d.orphanLock);
+                d.orphans.insert(d.orphans.end(), retired.begin(), retired.end());
+            }
+            d.slot[slot].state.store(0);
+            d.slot[slot].used.store(false);
+        }
+    };
+
+    struct Domain {
+        std::atomic<uint64_t> epoch {2};
+        Slot slot[MAXTHREADS];
+        std::mutex orphanLock;
+        std::vector<Retired> orphans;
+
+        ~Domain() {
+            for(Retired& r : orphans)
+                r.deleter(r.pointer);
+        }
+    };
+
+    static Domain& domain() {
+        static Domain d;
+        return d;
+    }
+
+    static ThreadState& self() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    /**
+     * @brief Advances the global epoch if every active thread has seen the current one.
+     */
+    static uint64_t tryAdvance() {
+        Domain& d = domain();
+        uint64_t e = d.epoch.load();
+        for(int i = 0; i < MAXTHREADS; i++) {
+            uint64_t s = d.slot[i].state.load();
+            if((s & 1) && (s >> 1) != e)
+                return e;
+        }
+        d.epoch.compare_exchange_strong(e, e + 1);
+        return d.epoch.load();
+    }
+
+    /**
+     * @brief Frees the calling thread's retired pointers whose grace period is over.
+     */
+    static void collect(ThreadState& t) {
+        Domain& d = domain();
+        if(d.orphanLock.try_lock()) {
+            t.retired.insert(t.retired.end(), d.orphans.begin(), d.orphans.end());
+            d.orphans.clear();
+            d.orphanLock.unlock();
+        }
+        uint64_t e = tryAdvance();
+        size_t kept = 0;
+        for(size_t i = 0; i < t.retired.size(); i++) {
+            if(t.retired[i].epoch + 2 <= e)
+                t.retired[i].deleter(t.retired[i].pointer);
+            else
+                t.retired[kept++] = t.retired[i];
+        }
+        t.retired.resize(kept);
+    }
+
+    public:
+        /**
+         * @brief Marks the calling thread as active in the current epoch for its lifetime. Guards nest.
+         */
+        class Guard {
+            public:
+                Guard() {
+                    ThreadState& t = self();
+                    if(t.depth++ > 0)
+                        return;
+                    Domain& d = domain();
+                    uint64_t e;
+                    do {
+                        e = d.epoch.load();
+                        d.slot[t.slot].state.store((e << 1) | 1);
+                    } while(d.epoch.load() != e);
+                }
+
+                ~Guard() {
+                    ThreadState& t = self();
+                    if(--t.depth == 0)
+                        domain().slot[t.slot].state.store(0);
+                }
+
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+        };
+
+        /**
+         * @brief Frees pointer with deleter once no thread can hold a reference to it anymore.
+         *          pointer must already be unreachable for threads entering a new guard.
+         *
+         * @param pointer
+         * @param deleter
+         */
+        static void retire(void* pointer, void (*deleter)(void*)) {
+            ThreadState& t = self();
+            t.retired.push_back({domain().epoch.load(), pointer, deleter});
+            if(t.retired.size() % 64 == 0)
+                collect(t);
+        }
+};
@@ -0,0 +1,500 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Stats.cpp"
+
+/**
+ * @brief Scapegoat tree set whose leaves are sorted blocks of up to LEAF keys instead of single nodes.
+ *          Internal nodes only route: keys less than an internal node's key are on its left.
+ *          A full leaf is split in half under a new internal node, a leaf below a quarter of LEAF is merged with
+ *          a sibling leaf when both fit into three quarters of one. The tree is rebuilt when it holds less than
+ *          alpha of the most keys it had. A leaf that gets too deep for the number of leaves makes the first ancestor
+ *          that is too deep for the leaves below it the scapegoat; comparing key counts of siblings instead picks
+ *          small subtrees, since split leaves are half full next to full ones, and does not bound the depth.
+ *          Rebuilds relink the leaves under new internal nodes, merging small neighbours, without moving
+ *          the other keys.
+ *
+ *          search_key compares a whole leaf at once with SSE2, or AVX2 when compiled with -mavx2,
+ *          for 32 and 64 bit integral keys (64 bit needs AVX2), and scans it otherwise.
+ *
+ * @tparam K key.
+ * @tparam StatsPolicy NoStats, FullStats or ConcurrentStats, see Stats.cpp.
+ * @tparam LeafBytes bytes of keys per leaf, four cache lines by default.
+ */
+template<typename K, typename StatsPolicy = NoStats, int LeafBytes = 256>
+class FatScapegoatTree {
+    public:
+        static constexpr int LEAF = std::max<int>(8, LeafBytes / sizeof(K));
+
+    private:
+    struct Node {
+        bool leaf;
+    };
+
+    struct Internal : Node {
+        K key;
+        Node* left;
+        Node* right;
+
+        Internal(const K& key, Node* left, Node* right) : Node{false}, key(key), left(left), right(right) {}
+    };
+
+    struct Leaf : Node {
+        int count = 0;
+        K keys[LEAF] {};
+
+        Leaf() : Node{true} {}
+    };
+
+    Node* root = nullptr;
+    int size = 0;
+    int max_size = 0;
+    int leaves = 0;
+
+    //reused by every insert, remove and rebuild
+    std::vector<Internal*> path;
+    std::vector<Leaf*> scratch;
+    //internal nodes taken apart by flatten, linked through left, for build to reuse
+    Internal* spare = nullptr;
+
+    StatsPolicy statistics;
+
+    float alpha = 0.57;
+
+    /**
+     * @brief Deepest leaf allowed in a subtree of n leaves, counted in internal nodes.
+     *          Rounded up, since a balanced tree over n leaves already has leaves at depth ceil(log2(n)).
+     */
+    int h_alpha(int n) {
+        return n <= 1 ? 0 : ceil(log(n) / log(1/alpha));
+    }
+
+    static Internal* internal(Node* node) {
+        return static_cast<Internal*>(node);
+    }
+
+    static Leaf* leafOf(Node* node) {
+        return static_cast<Leaf*>(node);
+    }
+
+    /**
+     * @brief Counts the leaves of a subtree.
+     */
+    int blocks_of(Node* node) {
+        if(node->leaf)
+            return 1;
+        return blocks_of(internal(node)->left) + blocks_of(internal(node)->right);
+    }
+
+    /**
+     * @brief Position of the first key in leaf that is not less than key.
+     */
+    static int position(const Leaf* leaf, const K& key) {
+        int p = 0;
+        if constexpr(std::is_integral<K>::value) {
+            for(int i = 0; i < leaf->count; i++)
+                p += leaf->keys[i] < key;
+        } else {
+            while(p < leaf->count && leaf->keys[p] < key)
+                p++;
+        }
+        return p;
+    }
+
+    /**
+     * @brief Index of key in leaf, comparing a vector of keys at a time.
+     *          The vectors may read past count into the rest of the array, matches there are ignored.
+     *
+     * @return int index, -1 if key is not in the leaf.
+     */
+    static int find(const Leaf* leaf, const K& key) {
+        if constexpr(std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8)) {
+#if defined(__AVX2__)
+            constexpr int LANES = 32 / sizeof(K);
+            static_assert(LEAF % LANES == 0, "leaves must hold whole vectors");
+            __m256i k;
+            if constexpr(sizeof(K) == 4)
+                k = _mm256_set1_epi32(key);
+            else
+                k = _mm256_set1_epi64x(key);
+            for(int i = 0; i < leaf->count; i += LANES) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(leaf->keys + i));
+                __m256i eq;
+                if constexpr(sizeof(K) == 4)
+                    eq = _mm256_cmpeq_epi32(v, k);
+                else
+                    eq = _mm256_cmpeq_epi64(v, k);
+                unsigned mask = _mm256_movemask_epi8(eq);
+                if(mask != 0) {
+                    int j = i + __builtin_ctz(mask) / sizeof(K);
+                    return j < leaf->count ? j : -1;
+                }
+            }
+            return -1;
+#elif defined(__SSE2__)
+            if constexpr(sizeof(K) == 4) {
+                constexpr int LANES = 4;
+                static_assert(LEAF % LANES == 0, "leaves must hold whole vectors");
+                __m128i k = _mm_set1_epi32(key);
+                for(int i = 0; i < leaf->count; i += LANES) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(leaf->keys + i));
+                    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi32(v, k));
+                    if(mask != 0) {
+                        int j = i + __builtin_ctz(mask) / 4;
+                        return j < leaf->count ? j : -1;
+                    }
+                }
+                return -1;
+            }
+#endif
+        }
+        int p = position(leaf, key);
+        return p < leaf->count && leaf->keys[p] == key ? p : -1;
+    }
+
+    /**
+     * @brief Appends the leaves of the subtree x to scratch in order and moves its internal nodes to spare.
+     *          A leaf that fits into the previous one with it at most three quarters full is merged into it.
+     *
+     * @param x root of the subtree.
+     */
+    void flatten(Node* x) {
+        if(!x->leaf) {
+            Internal* in = internal(x);
+            flatten(in->left);
+            flatten(in->right);
+            in->left = spare;
+            spare = in;
+            return;
+        }
+        Leaf* leaf = leafOf(x);
+        if(!scratch.empty() && scratch.back()->count + leaf->count <= LEAF * 3 / 4) {
+            Leaf* previous = scratch.back();
+            std::copy(leaf->keys, leaf->keys + leaf->count, previous->keys + previous->count);
+            previous->count += leaf->count;
+            delete leaf;
+            leaves--;
+            return;
+        }
+        scratch.push_back(leaf);
+    }
+
+    /**
+     * @brief Builds a perfectly balanced tree of internal nodes over the leaves scratch[lo..hi).
+     *          Takes the internal nodes from spare, which flatten filled with at least as many.
+     *
+     * @param lo
+     * @param hi
+     * @return Node* to the root of the built tree.
+     */
+    Node* build(int lo, int hi) {
+        if(hi - lo == 1)
+            return scratch[lo];
+        int mid = lo + (hi - lo) / 2;
+        Internal* in = spare;
+        spare = internal(in->left);
+        in->key = scratch[mid]->keys[0];
+        in->left = build(lo, mid);
+        in->right = build(mid, hi);
+        return in;
+    }
+
+    /**
+     * @brief Rebuilds the subtree x into a perfectly balanced tree over its leaves, reusing its internal nodes,
+     *          so it does not allocate. The ones left over from merged leaves are deleted.
+     *
+     * @param x root of the subtree.
+     * @return Node* to the root of the rebuilt subtree.
+     */
+    Node* rebuild(Node* x) {
+        long start = statistics.now();
+        scratch.clear();
+        flatten(x);
+        Node* r = build(0, scratch.size());
+        while(spare) {
+            Internal* next = internal(spare->left);
+            delete spare;
+            spare = next;
+        }
+        statistics.rebuild(scratch.size(), start);
+        return r;
+    }
+
+    /**
+     * @brief Deletes the subtree x.
+     */
+    void destroy(Node* x) {
+        if(!x->leaf) {
+            destroy(internal(x)->left);
+            destroy(internal(x)->right);
+            delete internal(x);
+        } else {
+            delete leafOf(x);
+        }
+    }
+
+    /**
+     * @brief Link that points to path[d], the root link for d = 0.
+     */
+    Node** link_to(int d) {
+        if(d == 0)
+            return &root;
+        return path[d - 1]->left == path[d] ? &path[d - 1]->left : &path[d - 1]->right;
+    }
+
+    /**
+     * @brief Finds the leaf that holds or would hold key, with its internal ancestors in path.
+     */
+    Leaf* descend(const K& key) {
+        path.clear();
+        Node* n = root;
+        while(!n->leaf) {
+            path.push_back(internal(n));
+            n = key < internal(n)->key ? internal(n)->left : internal(n)->right;
+        }
+        return leafOf(n);
+    }
+
+    /**
+     * @brief Walks up from leaf, whose ancestors are in path, and rebuilds the first ancestor that is deeper
+     *          above leaf than h_alpha of its leaves. The root is one, since leaf is too deep for the whole tree.
+     *          Only the sibling subtrees are counted, the child's count is reused.
+     */
+    void rebalance(Leaf* leaf) {
+        Node* child = leaf;
+        int child_blocks = 1;
+        for(int d = (int) path.size() - 1; d >= 0; d--) {
+            Internal* n = path[d];
+            int n_blocks = child_blocks + blocks_of(n->left == child ? n->right : n->left);
+            if((int) path.size() - d > h_alpha(n_blocks)) {
+                Node** link = link_to(d);
+                *link = rebuild(n);
+                return;
+            }
+            child = n;
+            child_blocks = n_blocks;
+        }
+    }
+
+    public:
+        /**
+         * @brief Construct a new Fat Scapegoat Tree.
+         *
+         * @param alpha balance factor, 0.5 < alpha < 1.
+         */
+        FatScapegoatTree(float alpha = 0.57) {
+            this->alpha = alpha;
+        }
+
+        ~FatScapegoatTree() {
+            clear();
+        }
+
+        FatScapegoatTree(const FatScapegoatTree&) = delete;
+        FatScapegoatTree& operator=(const FatScapegoatTree&) = delete;
+
+        /**
+         * @brief Removes every key.
+         */
+        void clear() {
+            if(root)
+                destroy(root);
+            root = nullptr;
+            size = max_size = leaves = 0;
+        }
+
+        /**
+         * @brief Inserts a key into its leaf. A full leaf is split first, and if that made the leaf too deep
+         *          a scapegoat above it is rebuilt.
+         *
+         * @param key
+         * @return int - 1 = success, -1 duplicate key.
+         */
+        int insert(K key) {
+            if(root == nullptr) {
+                Leaf* leaf = new Leaf();
+                leaf->keys[0] = key;
+                leaf->count = 1;
+                root = leaf;
+                leaves = size = max_size = 1;
+                statistics.insert();
+                return 1;
+            }
+            Leaf* leaf = descend(key);
+            int p = position(leaf, key);
+            if(p < leaf->count && leaf->keys[p] == key)
+                return -1;
+
+            bool split = leaf->count == LEAF;
+            if(split) {
+                Node** link = path.empty() ? &root : (path.back()->left == leaf ? &path.back()->left : &path.back()->right);
+                Leaf* right = new Leaf();
+                int half = LEAF / 2;
+                std::copy(leaf->keys + half, leaf->keys + LEAF, right->keys);
+                right->count = LEAF - half;
+                leaf->count = half;
+                Internal* in = new Internal(right->keys[0], leaf, right);
+                *link = in;
+                path.push_back(in);
+                leaves++;
+                if(p > half) {
+                    leaf = right;
+                    p -= half;
+                }
+            }
+            std::copy_backward(leaf->keys + p, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+            leaf->keys[p] = key;
+            leaf->count++;
+            size++;
+            max_size = std::max(max_size, size);
+            statistics.insert();
+
+            //only a split makes a leaf deeper
+            if(split && (int) path.size() > h_alpha(leaves))
+                rebalance(leaf);
+            return 1;
+        }
+
+        /**
+         * @brief Removes a key from its leaf. A small leaf is merged with its sibling leaf if both fit,
+         *          an empty one is removed with its parent. Rebuilds the whole tree when it holds
+         *          less than alpha of the most keys it had since the last full rebuild.
+         *
+         * @param key
+         * @return int - 1 = success, 0 = key not found.
+         */
+        int remove(K key) {
+            if(root == nullptr)
+                return 0;
+            Leaf* leaf = descend(key);
+            int p = find(leaf, key);
+            if(p < 0)
+                return 0;
+            std::copy(leaf->keys + p + 1, leaf->keys + leaf->count, leaf->keys + p);
+            leaf->count--;
+            size--;
+            statistics.remove();
+
+            if(path.empty()) {
+                if(leaf->count == 0) {
+                    delete leaf;
+                    root = nullptr;
+                    leaves = 0;
+                }
+            } else if(leaf->count < LEAF / 4) {
+                Internal* parent = path.back();
+                Node* sibling = parent->left == leaf ? parent->right : parent->left;
+                Node** link = link_to(path.size() - 1);
+                if(sibling->leaf && leafOf(sibling)->count + leaf->count <= LEAF * 3 / 4) {
+                    Leaf* first = leafOf(parent->left);
+                    Leaf* second = leafOf(parent->right);
+                    std::copy(second->keys, second->keys + second->count, first->keys + first->count);
+                    first->count += second->count;
+                    delete second;
+                    *link = first;
+                    delete parent;
+                    leaves--;
+                } else if(leaf->count == 0) {
+                    *link = sibling;
+                    delete leaf;
+                    delete parent;
+                    leaves--;
+                }
+            }
+
+            if(root != nullptr && size < alpha * max_size) {
+                root = rebuild(root);
+                max_size = size;
+            }
+            return 1;
+        }
+
+        /**
+         * @brief Searches for key.
+         *
+         * @param key
+         * @return K* to the key in its leaf, valid until the next insert or remove, null if not found.
+         */
+        K* search_key(K key) {
+            if(root == nullptr)
+                return nullptr;
+            int comps = 1;
+            Node* n = root;
+            while(!n->leaf) {
+                comps++;
+                n = key < internal(n)->key ? internal(n)->left : internal(n)->right;
+            }
+            statistics.search(comps);
+            int i = find(leafOf(n), key);
+            return i < 0 ? nullptr : &leafOf(n)->keys[i];
+        }
+
+        /**
+         * @brief Rebuilds the whole tree into a perfectly balanced one, packing small neighbouring leaves.
+         */
+        void rebalance() {
+            if(root == nullptr)
+                return;
+            root = rebuild(root);
+            max_size = size;
+        }
+
+        /**
+         * @brief Calls f(key) on every key in order.
+         */
+        template<typename F>
+        void for_each(F f) {
+            if(root)
+                visit(root, f);
+        }
+
+        /*
+        * ---- Getters:
+        */
+        int getSize() {
+            return size;
+        }
+
+        int getLeaves() {
+            return leaves;
+        }
+
+        /**
+         * @brief Snapshot of the counters kept by StatsPolicy, plus size and height,
+         *          the internal nodes plus the leaf on the longest path. Measured by walking the tree.
+         *
+         * @return Stats
+         */
+        Stats stats() {
+            Stats s;
+            statistics.collect(s);
+            s.size = size;
+            s.height = root ? height_of(root) : 0;
+            return s;
+        }
+
+    private:
+        template<typename F>
+        void visit(Node* n, F& f) {
+            if(n->leaf) {
+                for(int i = 0; i < leafOf(n)->count; i++)
+                    f(leafOf(n)->keys[i]);
+                return;
+            }
+            visit(internal(n)->left, f);
+            visit(internal(n)->right, f);
+        }
+
+        int height_of(Node* n) {
+            if(n->leaf)
+                return 1;
+            return std::max(height_of(internal(n)->left), height_of(internal(n)->right)) + 1;
+        }
+};
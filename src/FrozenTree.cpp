@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+/**
+ * @brief Read-only sorted set of keys stored in Eytzinger (BFS) order.
+ *          Node i has its children at 2i and 2i+1, so a search walks down a contiguous array
+ *          instead of chasing pointers. Created with ScapegoatTree::freeze().
+ *
+ * @tparam K
+ * @tparam Compare order of the keys, the one of the tree it was frozen from.
+ */
+template<typename K, typename Compare = std::less<K>>
+class FrozenTree {
+    std::vector<K> keys; // 1-indexed, keys[0] is unused
+    int size = 0;
+    Compare comp;
+
+    // keys per cache line, used to prefetch four levels ahead.
+    static constexpr int block = sizeof(K) < 64 ? 64 / sizeof(K) : 1;
+
+    /**
+     * @brief Places the sorted keys into their Eytzinger positions by an in-order walk of the implicit tree.
+     *
+     * @param sorted iterator to the next sorted key to place.
+     * @param k position in keys.
+     */
+    template<typename It>
+    void place(It& sorted, int k) {
+        if(k > size)
+            return;
+        place(sorted, 2 * k);
+        keys[k] = *sorted;
+        ++sorted;
+        place(sorted, 2 * k + 1);
+    }
+
+    /**
+     * @brief Branchless search for the first key not less than key.
+     *
+     * @param key
+     * @return int position in keys, 0 if every key is less than key.
+     */
+    int lower_bound_index(const K& key) const {
+        const K* t = keys.data();
+        int k = 1;
+        while(k <= size) {
+            __builtin_prefetch(t + (long) k * block);
+            k = 2 * k + comp(t[k], key);
+        }
+        // the answer is the last node where the search went left.
+        k >>= __builtin_ffs(~k);
+        return k;
+    }
+
+    public:
+        FrozenTree() : keys(1) {}
+
+        /**
+         * @brief Construct from n sorted keys.
+         *
+         * @param sorted iterator to the smallest key.
+         * @param n number of keys.
+         * @param compare order the keys are sorted in.
+         */
+        template<typename It>
+        FrozenTree(It sorted, int n, const Compare& compare = Compare()) : keys(n + 1), size(n), comp(compare) {
+            place(sorted, 1);
+        }
+
+        /**
+         * @brief Searches for the key.
+         *
+         * @param key
+         * @return const K* to the stored key or null if it was not found.
+         */
+        const K* search_key(const K& key) const {
+            int k = lower_bound_index(key);
+            if(k == 0 || comp(key, keys[k]))
+                return nullptr;
+            return &keys[k];
+        }
+
+        /**
+         * @brief Finds the smallest key not less than key.
+         *
+         * @param key
+         * @return const K* or null if every key is less than key.
+         */
+        const K* lower_bound(const K& key) const {
+            int k = lower_bound_index(key);
+            if(k == 0)
+                return nullptr;
+            return &keys[k];
+        }
+
+        int getSize() const {
+            return size;
+        }
+};
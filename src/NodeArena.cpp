@@ -0,0 +1,202 @@
+#pragma once
+
+#include <new>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+
+/**
+ * @brief Slab arena for container nodes. Memory is cut from large pages by bumping a cursor,
+ *          freed blocks go to a free list per size class (multiples of GRAIN bytes) and are handed out again
+ *          before the page is touched, so skiplist nodes of different levels each reuse their own size.
+ *          release() gives every page back at once without looking at what was allocated from it.
+ *
+ *          Also a std::pmr::memory_resource, so it can back pmr containers or a polymorphic_allocator.
+ *          Blocks aligned to more than GRAIN are cut from the pages too but not reused until release.
+ *          Not thread safe.
+ */
+class NodeArena : public std::pmr::memory_resource {
+    public:
+        static const size_t GRAIN = alignof(std::max_align_t);
+
+    private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    size_t pageBytes;
+    std::vector<void*> pages;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    //free list per size class, index = bytes / GRAIN
+    std::vector<FreeBlock*> freeLists;
+    size_t reserved = 0;
+
+    static size_t rounded(size_t bytes) {
+        return bytes == 0 ? GRAIN : (bytes + GRAIN - 1) / GRAIN * GRAIN;
+    }
+
+    /**
+     * @brief Memory for a block of bytes that does not fit the current page. Blocks of more than a quarter page
+     *          get a page of their own, so the rest of the current page is not wasted on them.
+     */
+    void* refill(size_t bytes) {
+        if(bytes > pageBytes / 4) {
+            void* block = ::operator new(bytes);
+            pages.push_back(block);
+            reserved += bytes;
+            return block;
+        }
+        cursor = static_cast<char*>(::operator new(pageBytes));
+        pages.push_back(cursor);
+        reserved += pageBytes;
+        limit = cursor + pageBytes;
+        void* block = cursor;
+        cursor += bytes;
+        return block;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if(alignment <= GRAIN)
+            return get(bytes);
+        //over-aligned: pad from a page, never put on a free list
+        void* block = get(rounded(bytes) + alignment);
+        size_t address = reinterpret_cast<size_t>(block);
+        return reinterpret_cast<void*>((address + alignment - 1) / alignment * alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if(alignment <= GRAIN)
+            put(p, bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    public:
+        /**
+         * @brief Construct an empty arena. No memory is taken until the first allocation.
+         *
+         * @param pageBytes size of the pages blocks are cut from.
+         */
+        explicit NodeArena(size_t pageBytes = 1 << 16) : pageBytes(rounded(pageBytes)) {}
+
+        ~NodeArena() {
+            release();
+        }
+
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        /**
+         * @brief A block of at least bytes, aligned to GRAIN. Taken from the free list of its size if possible.
+         */
+        void* get(size_t bytes) {
+            size_t n = rounded(bytes);
+            size_t c = n / GRAIN;
+            if(c < freeLists.size() && freeLists[c] != nullptr) {
+                FreeBlock* block = freeLists[c];
+                freeLists[c] = block->next;
+                return block;
+            }
+            if((size_t) (limit - cursor) < n)
+                return refill(n);
+            void* block = cursor;
+            cursor += n;
+            return block;
+        }
+
+        /**
+         * @brief Returns a block from get(bytes) to the free list of its size.
+         */
+        void put(void* p, size_t bytes) {
+            size_t c = rounded(bytes) / GRAIN;
+            if(c >= freeLists.size())
+                freeLists.resize(c + 1, nullptr);
+            FreeBlock* block = static_cast<FreeBlock*>(p);
+            block->next = freeLists[c];
+            freeLists[c] = block;
+        }
+
+        /**
+         * @brief Frees every page, invalidating every block handed out. Takes time per page, not per block.
+         */
+        void release() {
+            for(void* page : pages)
+                ::operator delete(page);
+            pages.clear();
+            freeLists.clear();
+            cursor = limit = nullptr;
+            reserved = 0;
+        }
+
+        /**
+         * @brief Bytes taken from the system, including free blocks and the unused rest of the current page.
+         */
+        size_t getReserved() {
+            return reserved;
+        }
+};
+
+/**
+ * @brief Allocator handing out memory from a NodeArena. A default constructed allocator creates its own arena,
+ *          copies and rebinds share it, and the arena lives until the last of them is gone.
+ *          A container holding the only ArenaAllocator of its arena frees all its nodes with NodeArena::release,
+ *          see ArenaOwner. Containers sharing an arena, or whose allocator is still held elsewhere, free node by node.
+ */
+template<typename T>
+class ArenaAllocator {
+    template<typename U>
+    friend class ArenaAllocator;
+
+    std::shared_ptr<NodeArena> arena;
+
+    public:
+        using value_type = T;
+
+        ArenaAllocator() : arena(std::make_shared<NodeArena>()) {}
+
+        explicit ArenaAllocator(std::shared_ptr<NodeArena> arena) : arena(std::move(arena)) {}
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+        T* allocate(size_t n) {
+            static_assert(alignof(T) <= NodeArena::GRAIN, "ArenaAllocator: over-aligned type");
+            return static_cast<T*>(arena->get(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n) {
+            arena->put(p, n * sizeof(T));
+        }
+
+        NodeArena& resource() const {
+            return *arena;
+        }
+
+        /**
+         * @brief Checks if this is the only allocator using its arena.
+         */
+        bool exclusive() const {
+            return arena.use_count() == 1;
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+/**
+ * @brief Tells a container if its allocator is an ArenaAllocator, which lets clear() and the destructor release
+ *          the arena instead of freeing node by node. Only done when the nodes need no destructor calls
+ *          and the container's allocator is exclusive().
+ */
+template<typename Alloc>
+struct ArenaOwner : std::false_type {};
+
+template<typename T>
+struct ArenaOwner<ArenaAllocator<T>> : std::true_type {};
@@ -1,28 +1,179 @@
-#include <stack>
+#pragma once
+
+#include <vector>
+#include <iterator>
 #include <iomanip>
+#include <type_traits>
+#include <optional>
+#include <thread>
+
+#include "FrozenTree.cpp"
+#include "Stats.cpp"
+#include "Snapshot.cpp"
+#include "NodeArena.cpp"
+#include "Compare.cpp"
+
+/**
+ * @brief Optional parts of a ScapegoatTree node. The empty specializations take no space,
+ *          so a set without subtree sizes keeps the plain key + two pointers node.
+ */
+template<typename V>
+struct ScapegoatValue {
+    V value {};
+
+    ScapegoatValue() = default;
+
+    template<typename... Args>
+    explicit ScapegoatValue(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...) {}
+};
+
+template<>
+struct ScapegoatValue<void> {
+    ScapegoatValue() = default;
+
+    explicit ScapegoatValue(std::in_place_t) {}
+};
+
+template<bool SubtreeSizes>
+struct ScapegoatCount {
+    int count = 1;
+};
 
-template<typename K>
+template<>
+struct ScapegoatCount<false> {};
+
+/**
+ * @brief Scapegoat tree set, or map when V is not void.
+ * 
+ * @tparam K key.
+ * @tparam V value stored with each key, void for a set.
+ * @tparam SubtreeSizes keep the size of every subtree in its root, for rank/select and O(1) weight checks.
+ * @tparam StatsPolicy NoStats, FullStats or ConcurrentStats, see Stats.cpp.
+ * @tparam Compare strict weak order on keys, see three_way in Compare.cpp for how a search compares once per node.
+ *          If it has is_transparent (like std::less<>), search_key, find, remove and emplace also take other key types
+ *          it can compare, e.g. std::string_view for std::string keys.
+ * @tparam Alloc allocator for the nodes, rebound to the node type, e.g. std::pmr::polymorphic_allocator
+ *          or ArenaAllocator (see NodeArena.cpp).
+ */
+template<typename K, typename V = void, bool SubtreeSizes = false, typename StatsPolicy = NoStats,
+    typename Compare = std::less<K>, typename Alloc = std::allocator<char>>
 class ScapegoatTree {
-    struct Node {
+    /**
+     * @brief Nodes do not own their children, subtrees are freed by destroy.
+     */
+    struct Node : ScapegoatValue<V>, ScapegoatCount<SubtreeSizes> {
         K key;
         Node* left = nullptr;
         Node* right = nullptr;
 
-        Node(K key) : key(key) {}
+        template<typename KK>
+        explicit Node(KK&& key) : key(std::forward<KK>(key)) {}
 
-        ~Node() {
-            delete left;            
-            delete right;
-        }
+        //map mode: the value is constructed from args
+        template<typename KK, typename... Args>
+        Node(KK&& key, std::in_place_t, Args&&... args)
+            : ScapegoatValue<V>(std::in_place, std::forward<Args>(args)...), key(std::forward<KK>(key)) {}
     };
 
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+    //with an arena and nodes without destructors, clear and the destructor just release the arena
+    static constexpr bool RELEASES = ArenaOwner<NodeAlloc>::value && std::is_trivially_destructible<Node>::value;
+
+    NodeAlloc alloc;
+    Compare comp;
+
     Node* root = nullptr;
     int size = 0;
     int max_size = 0;
+
+    //reused by every rebuild, holds the flattened subtree
+    std::vector<Node*> scratch;
+
+    //threads used to build large rebuilds, see setRebuildThreads
+    int rebuildThreads = 1;
+    static const int PARALLEL_CUTOFF = 1 << 16;
+
+    //nodes of rebuild work per update in incremental mode, 0 = off, see setIncrementalRebuild
+    int incrementalStep = 0;
+    //depth of the last insert, lets incremental rebuilds speed up while the tree is too deep
+    int lastDepth = 0;
+
+    //incremental rebuilds copy the values of the old subtree, which keeps serving searches until the swap
+    static constexpr bool COPIES = std::is_void<V>::value
+        || (std::is_copy_constructible<V>::value && std::is_copy_assignable<V>::value);
+
+    //ancestors an insert keeps on the stack, enough for h_alpha() of any int size up to alpha = 0.7
+    static const int PATH = 64;
+
+    /**
+     * @brief An update that hit the key range of an incremental rebuild, replayed on the new subtree.
+     *          Values are not logged: the replay of an INSERT, which also stands for an assignment,
+     *          takes the key's value from the old tree as it is then.
+     */
+    struct LogEntry {
+        enum Op : char { INSERT, REMOVE } op;
+        K key;
+    };
+
+    /**
+     * @brief State of the incremental rebuild of the subtree holding the keys in (lo, hi).
+     *          COLLECT copies the old subtree in key order, BUILD links the copies into a balanced tree,
+     *          REPLAY applies the logged updates to it and then swaps it in, FREE deletes the old subtree.
+     *          Until the swap, every operation works on the old subtree as usual.
+     */
+    struct RebuildJob {
+        enum Phase { IDLE, COLLECT, BUILD, REPLAY, FREE } phase = IDLE;
+        std::optional<K> lo, hi;
+        bool whole = false;     // rebuilding the whole tree
+        std::optional<K> last;  // last key copied
+        std::vector<Node*> nodes;
+        std::vector<Node*> path;
+        struct Range {
+            int lo, hi;
+            Node** link;
+        };
+        std::vector<Range> ranges;
+        Node* built = nullptr;
+        std::vector<LogEntry> log;
+        size_t replayed = 0;
+        Node* garbage = nullptr;
+        int count = 0;          // nodes copied
+        int size = 0;           // nodes in built
+        long ns = 0;
+
+        bool holds(const K& key, const Compare& comp) const {
+            return (!lo || comp(*lo, key)) && (!hi || comp(key, *hi));
+        }
+
+        //between start and the swap, when the old subtree has to keep its keys together
+        bool active() const {
+            return phase == COLLECT || phase == BUILD || phase == REPLAY;
+        }
+    };
+    RebuildJob job;
+
+    //iterates the keys of a range of nodes
+    struct KeyIterator {
+        Node** node;
+        const K& operator*() const { return (*node)->key; }
+        KeyIterator& operator++() { ++node; return *this; }
+    };
     
-    //used to analysis
-    int comps = 0;
-    int restructs = 0;
+    StatsPolicy statistics;
+
+    static constexpr char MAGIC[] = "SGTREE\0";
+
+    /**
+     * @brief Bytes per value in a snapshot, 0 for a set.
+     */
+    static constexpr uint32_t valueSize() {
+        if constexpr(std::is_void<V>::value)
+            return 0;
+        else
+            return sizeof(V);
+    }
 
     float alpha = 0.57;
     int h_alpha() {
@@ -38,59 +189,504 @@ class ScapegoatTree {
     int size_of(Node* node) {
         if(node == nullptr)
             return 0;
-        return (size_of(node->left) + size_of(node->right)) + 1;
+        if constexpr(SubtreeSizes)
+            return node->count;
+        else
+            return (size_of(node->left) + size_of(node->right)) + 1;
+    }
+
+    /**
+     * @brief Size of a node, counting at most about limit nodes.
+     * 
+     * @param node 
+     * @param limit 
+     * @return int the size if it is at most limit, otherwise some value >= limit.
+     */
+    int size_upto(Node* node, int limit) {
+        if constexpr(SubtreeSizes)
+            return size_of(node);
+        if(node == nullptr || limit <= 0)
+            return 0;
+        int left = size_upto(node->left, limit - 1);
+        return 1 + left + (left < limit - 1 ? size_upto(node->right, limit - 1 - left) : 0);
+    }
+
+    /**
+     * @brief Adds d to the subtree size of node, if sizes are kept.
+     */
+    void resize(Node* node, int d) {
+        if constexpr(SubtreeSizes)
+            node->count += d;
+    }
+
+    /**
+     * @brief Builds the nodes scratch[lo..hi) into a perfectly balanced binary tree.
+     *          Iterative, the range stack is bounded by the height of the result.
+     * 
+     * @param lo 
+     * @param hi 
+     * @return Node* to the root of the built tree.
+     */
+    Node* build(int lo, int hi) {
+        struct Range {
+            int lo, hi;
+            Node** link;
+        };
+        Range stack[64];
+        int top = 0;
+        Node* r = nullptr;
+        stack[top++] = {lo, hi, &r};
+        while(top > 0) {
+            Range range = stack[--top];
+            if(range.lo >= range.hi) {
+                *range.link = nullptr;
+                continue;
+            }
+            int mid = range.lo + (range.hi - range.lo) / 2;
+            Node* m = scratch[mid];
+            *range.link = m;
+            if constexpr(SubtreeSizes)
+                m->count = range.hi - range.lo;
+            stack[top++] = {range.lo, mid, &m->left};
+            stack[top++] = {mid + 1, range.hi, &m->right};
+        }
+        return r;
+    }
+
+    /**
+     * @brief build(lo, hi) with the left half built on a new thread, threads times recursively.
+     *          Ranges below PARALLEL_CUTOFF nodes are built sequentially. The threads only read scratch
+     *          and each writes the links of its own nodes, so they share nothing else.
+     * 
+     * @param lo 
+     * @param hi 
+     * @param threads threads that may work on this range, including the calling one.
+     * @return Node* to the root of the built tree, the same shape build(lo, hi) gives.
+     */
+    Node* build_parallel(int lo, int hi, int threads) {
+        if(threads <= 1 || hi - lo < PARALLEL_CUTOFF)
+            return build(lo, hi);
+        int mid = lo + (hi - lo) / 2;
+        Node* m = scratch[mid];
+        Node* left;
+        std::thread worker ([&]() { left = build_parallel(lo, mid, threads / 2); });
+        m->right = build_parallel(mid + 1, hi, threads - threads / 2);
+        worker.join();
+        m->left = left;
+        if constexpr(SubtreeSizes)
+            m->count = hi - lo;
+        return m;
     }
 
     /**
-     * @brief Builds n number of nodes into a binary tree.
+     * @brief Builds the nodes scratch[0..n) into a perfectly balanced binary tree,
+     *          on rebuildThreads threads if n is large enough.
      * 
      * @param n Number of nodes to build.
-     * @param x linked list of nodes, must contain n+1 nodes.
-     * @return Node* to the node which points to the built tree using its left pointer.
-     */
-    Node* build(float n, Node* x) {
-        if (n == 0.0) {
-            x->left = nullptr;
-            return x;
-        }
-        Node* r = build(ceil((n-1)/2), x);
-        Node* s = build(floor((n-1)/2), r->right);
-        r->right = s->left;
-        s->left = r;
-        return s;
+     * @return Node* to the root of the built tree.
+     */
+    Node* build(int n) {
+        if(rebuildThreads > 1 && n >= PARALLEL_CUTOFF)
+            return build_parallel(0, n, rebuildThreads);
+        return build(0, n);
     }
 
     /**
-     * @brief Creates a linked list of two lists of Node objects and linking them together using the right pointer.
+     * @brief Appends the nodes of the subtree x to scratch in sorted order.
+     *          Iterative, rotates left children up so the subtree is consumed as a right-going list.
      * 
-     * @param x first node of the first list.
-     * @param y first node of the second list.
-     * @return Node* to the first node of the list
+     * @param x root of the subtree.
      */
-    Node* flatten(Node* x, Node* y) {
-        if(x == nullptr)
-            return y;
-        x->right = flatten(x->right, y);
-        return flatten(x->left, x);
+    void flatten(Node* x) {
+        while(x) {
+            if(x->left) {
+                Node* l = x->left;
+                x->left = l->right;
+                l->right = x;
+                x = l;
+            } else {
+                scratch.push_back(x);
+                x = x->right;
+            }
+        }
     }
 
+    /**
+     * @brief Appends the nodes of this whole tree to out in sorted order, see flatten.
+     */
+    void flatten_into(std::vector<Node*>& out) {
+        scratch.swap(out);
+        flatten(root);
+        scratch.swap(out);
+    }
 
-    /* used to remove left pointers in the flattened tree */
     /**
-     * @brief Calls flatten and removes left pointers in the flattened list.
+     * @brief Rebuilds the subtree x into a perfectly balanced tree.
      * 
-     * @param x first node of the first list.
-     * @param y first node of the second list.
-     * @return Node* to the first node of the list
-     */
-    Node* flatten_wrapper(Node* x, Node* y) {
-        Node* n = flatten(x, y);
-        Node* tmp = n;
-        while(tmp) {
-            tmp->left = nullptr;
-            tmp = tmp->right;
-        }
-        return n;
+     * @param x root of the subtree.
+     * @return Node* to the root of the rebuilt subtree.
+     */
+    Node* rebuild(Node* x) {
+        long start = statistics.now();
+        scratch.clear();
+        flatten(x);
+        Node* r = build(scratch.size());
+        statistics.rebuild(scratch.size(), start);
+        return r;
+    }
+
+    template<typename... Args>
+    Node* createNode(Args&&... args) {
+        Node* node = NodeTraits::allocate(alloc, 1);
+        NodeTraits::construct(alloc, node, std::forward<Args>(args)...);
+        return node;
+    }
+
+    void destroyNode(Node* node) {
+        NodeTraits::destroy(alloc, node);
+        NodeTraits::deallocate(alloc, node, 1);
+    }
+
+    /**
+     * @brief Frees every node by releasing the arena, if the nodes come from an arena only this tree uses
+     *          and need no destructor calls.
+     * @return true if it did.
+     */
+    bool release_nodes() {
+        if constexpr(RELEASES) {
+            if(alloc.exclusive()) {
+                alloc.resource().release();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Deletes every node of the subtree x without recursion or extra memory,
+     *          rotating left children up like flatten and deleting each node once it has none.
+     * 
+     * @param x root of the subtree.
+     */
+    void destroy(Node* x) {
+        while(x) {
+            if(x->left) {
+                Node* l = x->left;
+                x->left = l->right;
+                l->right = x;
+                x = l;
+            } else {
+                Node* next = x->right;
+                destroyNode(x);
+                x = next;
+            }
+        }
+    }
+
+    /**
+     * @brief Link to the subtree the incremental rebuild works on: the one that holds every key in (job.lo, job.hi).
+     *          Found by descending from the root, since the nodes above it may be removed.
+     */
+    Node** job_link() {
+        Node** link = &root;
+        while(*link && !job.holds((*link)->key, comp))
+            link = job.hi && !comp((*link)->key, *job.hi) ? &(*link)->left : &(*link)->right;
+        return link;
+    }
+
+    /**
+     * @brief Checks if the subtree n contains the subtree of the active incremental rebuild.
+     */
+    bool covers_job(Node* n) {
+        for(Node* current = root; current != nullptr; ) {
+            if(current == n)
+                return true;
+            if(job.holds(current->key, comp))
+                return false;
+            current = job.hi && !comp(current->key, *job.hi) ? current->left : current->right;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Decides what happens to a rebuild of the subtree n, of nodes nodes, while rebuilds may be incremental.
+     *          Rebuilds of a subtree containing the one being rebuilt incrementally are postponed, as are large
+     *          rebuilds while another one is in progress; the scapegoat checks find them again later.
+     * 
+     * @param n root of the subtree.
+     * @param nodes size of the subtree.
+     * @return true if the rebuild was started incrementally or postponed, false if the caller rebuilds now.
+     */
+    bool defer_rebuild(Node* n, int nodes) {
+        if(job.active() && covers_job(n))
+            return true;
+        if(incrementalStep == 0 || nodes <= incrementalStep)
+            return false;
+        if(job.phase != RebuildJob::IDLE)
+            return true;
+        job.lo.reset();
+        job.hi.reset();
+        for(Node* current = root; current != n; ) {
+            if(comp(n->key, current->key)) {
+                job.hi = current->key;
+                current = current->left;
+            } else {
+                job.lo = current->key;
+                current = current->right;
+            }
+        }
+        job.whole = n == root;
+        job.last.reset();
+        job.nodes.clear();
+        job.nodes.reserve(nodes + nodes / 4);
+        job.log.clear();
+        job.replayed = 0;
+        job.ns = 0;
+        job.phase = RebuildJob::COLLECT;
+        return true;
+    }
+
+    /**
+     * @brief Copies up to budget nodes of the old subtree, continuing after the last key copied.
+     *          Seeks from the root every step, the old subtree may have changed since the last one.
+     */
+    void collect_step(int budget) {
+        job.path.clear();
+        for(Node* n = *job_link(); n != nullptr; ) {
+            if(!job.last || comp(*job.last, n->key)) {
+                job.path.push_back(n);
+                n = n->left;
+            } else {
+                n = n->right;
+            }
+        }
+        for(; budget > 0 && !job.path.empty(); budget--) {
+            Node* x = job.path.back();
+            job.path.pop_back();
+            if constexpr(std::is_void<V>::value)
+                job.nodes.push_back(createNode(x->key));
+            else if constexpr(COPIES)
+                job.nodes.push_back(createNode(x->key, std::in_place, x->value));
+            job.last = x->key;
+            for(Node* n = x->right; n != nullptr; n = n->left)
+                job.path.push_back(n);
+        }
+        if(job.path.empty()) {
+            job.count = job.size = job.nodes.size();
+            job.built = nullptr;
+            job.ranges.clear();
+            job.ranges.push_back({0, job.count, &job.built});
+            job.phase = RebuildJob::BUILD;
+        }
+    }
+
+    /**
+     * @brief Links up to budget of the copies, like build.
+     */
+    void build_step(int budget) {
+        while(budget > 0 && !job.ranges.empty()) {
+            typename RebuildJob::Range range = job.ranges.back();
+            job.ranges.pop_back();
+            if(range.lo >= range.hi) {
+                *range.link = nullptr;
+                continue;
+            }
+            budget--;
+            int mid = range.lo + (range.hi - range.lo) / 2;
+            Node* m = job.nodes[mid];
+            *range.link = m;
+            if constexpr(SubtreeSizes)
+                m->count = range.hi - range.lo;
+            job.ranges.push_back({range.lo, mid, &m->left});
+            job.ranges.push_back({mid + 1, range.hi, &m->right});
+        }
+        if(job.ranges.empty())
+            job.phase = RebuildJob::REPLAY;
+    }
+
+    /**
+     * @brief Inserts or assigns a logged key in the new subtree. Keeps it balanced like insert_node,
+     *          but only with rebuilds of at most incrementalStep nodes, so a run of logged inserts
+     *          to the same place does not leave a long path behind.
+     */
+    void replay_insert(const LogEntry& e) {
+        //map mode: the value comes from the old tree, which is still the one linked in.
+        //A key that is not there any more was removed since, its REMOVE comes later in the log.
+        Node* old = nullptr;
+        if constexpr(!std::is_void<V>::value) {
+            int comps = 0;
+            if((old = lookup(e.key, comps)) == nullptr)
+                return;
+        }
+        job.path.clear();
+        Node** link = &job.built;
+        int c;
+        while(*link && (c = three_way(comp, e.key, (*link)->key)) != 0) {
+            job.path.push_back(*link);
+            link = c < 0 ? &(*link)->left : &(*link)->right;
+        }
+        Node* node;
+        if constexpr(std::is_void<V>::value) {
+            if(*link != nullptr)
+                return;
+            node = *link = createNode(e.key);
+        } else if constexpr(COPIES) {
+            if(*link != nullptr) {
+                (*link)->value = old->value;
+                return;
+            }
+            node = *link = createNode(e.key, std::in_place, old->value);
+        } else {
+            return;
+        }
+        for(Node* a : job.path)
+            resize(a, 1);
+        job.size++;
+        if((int) job.path.size() <= floor(log(job.size) / log(1/alpha)))
+            return;
+        Node* child = node;
+        int child_size = 1;
+        for(int d = (int) job.path.size() - 1; d >= 0; d--) {
+            Node* n = job.path[d];
+            int n_size = child_size + size_upto(n->left == child ? n->right : n->left, incrementalStep) + 1;
+            if(n_size > incrementalStep)
+                return;
+            if((int) job.path.size() - d > floor(log(n_size) / log(1/alpha))) {
+                Node* r = rebuild(n);
+                if(d == 0)
+                    job.built = r;
+                else if(job.path[d - 1]->left == n)
+                    job.path[d - 1]->left = r;
+                else
+                    job.path[d - 1]->right = r;
+                return;
+            }
+            child = n;
+            child_size = n_size;
+        }
+    }
+
+    /**
+     * @brief Applies up to budget logged updates to the new subtree. Once it has caught up,
+     *          swaps it in for the old subtree, which is left for the FREE phase.
+     */
+    void replay_step(int budget) {
+        for(; budget > 0 && job.replayed < job.log.size(); budget--) {
+            const LogEntry& e = job.log[job.replayed++];
+            if(e.op == LogEntry::REMOVE) {
+                int saved = size;
+                job.built = remove_recursive(job.built, e.key);
+                job.size -= saved - size;
+                size = saved;
+            } else {
+                replay_insert(e);
+            }
+        }
+        if(job.replayed < job.log.size())
+            return;
+        Node** link = job_link();
+        job.garbage = *link;
+        *link = job.built;
+        if(job.whole)
+            max_size = size;
+        statistics.rebuild(job.count, statistics.now() - job.ns);
+        job.log.clear();
+        job.nodes.clear();
+        job.phase = RebuildJob::FREE;
+    }
+
+    /**
+     * @brief Deletes up to budget nodes of the detached old subtree, consuming it like flatten.
+     */
+    void free_step(int budget) {
+        Node* x = job.garbage;
+        while(x && budget > 0) {
+            if(x->left) {
+                Node* l = x->left;
+                x->left = l->right;
+                l->right = x;
+                x = l;
+            } else {
+                Node* next = x->right;
+                destroyNode(x);
+                x = next;
+                budget--;
+            }
+        }
+        job.garbage = x;
+        if(x == nullptr)
+            job.phase = RebuildJob::IDLE;
+    }
+
+    /**
+     * @brief Does one step of the incremental rebuild, at most incrementalStep nodes of work. Called by every update.
+     */
+    void advance() {
+        if(job.phase == RebuildJob::IDLE)
+            return;
+        long start = statistics.now();
+        //postponed rebuilds let the tree grow deep, catch up faster when it has
+        int budget = std::max(16, incrementalStep) * std::max(1, lastDepth / (2 * std::max(1, h_alpha())));
+        switch(job.phase) {
+            case RebuildJob::COLLECT: collect_step(budget); break;
+            case RebuildJob::BUILD: build_step(budget); break;
+            case RebuildJob::REPLAY: replay_step(budget); break;
+            case RebuildJob::FREE: free_step(budget); break;
+            default: break;
+        }
+        job.ns += statistics.now() - start;
+    }
+
+    /**
+     * @brief Completes a pending incremental rebuild, before operations that restructure the whole tree.
+     */
+    void finish_rebuild() {
+        while(job.phase != RebuildJob::IDLE)
+            advance();
+    }
+
+    /**
+     * @brief Checks if a search for key passes through the subtree being rebuilt incrementally.
+     *          Keys outside (job.lo, job.hi) can end up there once a node above it has been removed.
+     */
+    bool reaches_job(const K& key) {
+        for(Node* current = root; current != nullptr; ) {
+            if(job.holds(current->key, comp))
+                return true;
+            int c = three_way(comp, key, current->key);
+            if(c == 0)
+                return false;
+            current = c < 0 ? current->left : current->right;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Records an update for the incremental rebuild if it can change the subtree being rebuilt.
+     */
+    void log_update(const K& key, typename LogEntry::Op op) {
+        if(!job.active())
+            return;
+        //keys the copying has not reached yet are copied in their current state anyway
+        if(job.phase == RebuildJob::COLLECT && (!job.last || comp(*job.last, key)))
+            return;
+        if(!(job.holds(key, comp) || reaches_job(key)))
+            return;
+        job.log.push_back(LogEntry{op, key});
+    }
+
+    /**
+     * @brief Checks if removing the node root, which has two children, would move its successor out of the
+     *          subtree being rebuilt incrementally, i.e. if that subtree is on the left spine of root->right.
+     *          Then remove_recursive takes the predecessor instead.
+     */
+    bool crosses_job(Node* root) {
+        if(!job.active() || job.holds(root->key, comp))
+            return false;
+        for(Node* succ = root->right; succ != nullptr; succ = succ->left)
+            if(job.holds(succ->key, comp))
+                return true;
+        return false;
     }
 
     /**
@@ -101,13 +697,26 @@ class ScapegoatTree {
      * @return int - 0 = right child, 1 = left child, -1 not a child.
      */
     int leftOrRightChild(Node* parent, Node* child) {
-        if(parent->left && parent->left->key == child->key)
+        if(parent->left == child)
             return 1;
-        else if(parent->right && parent->right->key == child->key)
+        else if(parent->right == child)
             return 0;
         return -1;
     }
 
+    /**
+     * @brief The ancestor at depth d (root = 0) on the path to key, where path holds the last PATH of depth
+     *          ancestors in a ring. Ancestors that were overwritten are found again from the root.
+     */
+    Node* ancestor_at(Node* const* path, int depth, int d, const K& key) {
+        if(d >= depth - PATH)
+            return path[d % PATH];
+        Node* a = root;
+        for(int j = 0; j < d; j++)
+            a = comp(key, a->key) ? a->left : a->right;
+        return a;
+    }
+
     /**
      * @brief Get the Minimum Key.
      * 
@@ -129,32 +738,60 @@ class ScapegoatTree {
      * @param key Key to remove.
      * @return Node* to the root of the tree.
      */
-    Node* remove_recursive(Node* root, K key) {
+    template<typename Q>
+    Node* remove_recursive(Node* root, const Q& key) {
         if(root == nullptr)
             return root;
-        if(root->key > key) {
+        int before = size;
+        int c = three_way(comp, key, root->key);
+        if(c < 0) {
             root->left = remove_recursive(root->left, key);
+            resize(root, size - before);
             return root;
         }
-        else if(root->key < key) {
+        else if(c > 0) {
             root->right = remove_recursive(root->right, key);
+            resize(root, size - before);
             return root;
         }
 
         if(root->left == nullptr) {
             Node* tmp = root->right;
-            delete root;
+            destroyNode(root);
             size--;
             return tmp;
         } else if(root->right == nullptr) {
             Node* tmp = root->left;
-            delete root;
+            destroyNode(root);
             size--;
             return tmp;
+        } else if(crosses_job(root)) {
+            Node* predParent = root;
+            Node* pred = root->left;
+            resize(root, -1);
+            while (pred->right != nullptr) {
+                resize(pred, -1);
+                predParent = pred;
+                pred = pred->right;
+            }
+
+            if (predParent != root)
+                predParent->right = pred->left;
+            else
+                predParent->left = pred->left;
+
+            root->key = std::move(pred->key);
+            if constexpr(!std::is_void<V>::value)
+                root->value = std::move(pred->value);
+            destroyNode(pred);
+            size--;
+            return root;
         } else {
             Node* succParent = root;
             Node* succ = root->right;
+            resize(root, -1);
             while (succ->left != nullptr) {
+                resize(succ, -1);
                 succParent = succ;
                 succ = succ->left;
             }
@@ -164,20 +801,181 @@ class ScapegoatTree {
             else
                 succParent->right = succ->right;
 
-            root->key = succ->key;
-            delete succ;
+            root->key = std::move(succ->key);
+            if constexpr(!std::is_void<V>::value)
+                root->value = std::move(succ->value);
+            destroyNode(succ);
             size--;
             return root;
         }   
     }   
 
     public:
-        ScapegoatTree(float alpha = 0.57) {
+        /**
+         * @brief Construct an empty tree.
+         * 
+         * @param alpha balance factor in [0.5, 1).
+         * @param compare order of the keys.
+         * @param allocator allocator the nodes come from.
+         */
+        ScapegoatTree(float alpha = 0.57, const Compare& compare = Compare(), const Alloc& allocator = Alloc())
+            : alloc(allocator), comp(compare) {
             this->alpha = alpha;
         }
 
+        /**
+         * @brief Construct a perfectly balanced tree from a sorted range of keys, see bulk_load.
+         */
+        template<typename It>
+        ScapegoatTree(It first, It last, float alpha = 0.57, const Compare& compare = Compare(), const Alloc& allocator = Alloc())
+            : alloc(allocator), comp(compare) {
+            this->alpha = alpha;
+            bulk_load(first, last);
+        }
+
         ~ScapegoatTree() {
-            delete root;
+            if(release_nodes())
+                return;
+            finish_rebuild();
+            destroy(root);
+        }
+
+        /**
+         * @brief Removes every key, without recursion. With an ArenaAllocator of its own and trivially destructible
+         *          keys and values the arena is released instead of visiting the nodes, and a pending incremental
+         *          rebuild is dropped with it.
+         */
+        void clear() {
+            if(release_nodes()) {
+                job.phase = RebuildJob::IDLE;
+                job.nodes.clear();
+                job.log.clear();
+                job.built = job.garbage = nullptr;
+            } else {
+                finish_rebuild();
+                destroy(root);
+            }
+            root = nullptr;
+            size = max_size = 0;
+            scratch.clear();
+        }
+
+        /**
+         * @brief Replaces the contents with a sorted range of keys in O(n). Duplicates are skipped.
+         *          The nodes go straight into the scratch buffer and are built into a perfectly balanced tree.
+         * 
+         * @param first 
+         * @param last 
+         */
+        template<typename It>
+        void bulk_load(It first, It last) {
+            clear();
+            for(; first != last; ++first) {
+                if(!scratch.empty() && !comp(scratch.back()->key, *first))
+                    continue;
+                scratch.push_back(createNode(*first));
+            }
+            size = max_size = scratch.size();
+            root = build(size);
+        }
+
+        /**
+         * @brief Writes the keys, and values in map mode, to a snapshot file in key order, see SnapshotHeader.
+         *          K and V must be trivially copyable.
+         * 
+         * @param path 
+         * @return int - 0 = success, -1 = the file could not be written.
+         */
+        int save(const char* path) {
+            static_assert(std::is_trivially_copyable<K>::value, "save needs trivially copyable keys");
+            SnapshotWriter out (path);
+            out.put(SnapshotHeader::make(MAGIC, sizeof(K), valueSize(), size));
+            for(iterator it = begin(); it != end(); ++it)
+                out.put(*it);
+            if constexpr(!std::is_void<V>::value) {
+                static_assert(std::is_trivially_copyable<V>::value, "save needs trivially copyable values");
+                for(iterator it = begin(); it != end(); ++it)
+                    out.put(it.value());
+            }
+            return out.close();
+        }
+
+        /**
+         * @brief Replaces the contents with a snapshot written by save, in O(n). The file is memory mapped,
+         *          the nodes go into the scratch buffer in key order and build makes a perfectly balanced tree.
+         * 
+         * @param path 
+         * @return int - 0 = success, -1 = the file could not be read, -2 = not a valid snapshot of this tree type.
+         *          The tree is empty after a failure.
+         */
+        int load(const char* path) {
+            static_assert(std::is_trivially_copyable<K>::value, "load needs trivially copyable keys");
+            clear();
+            SnapshotReader in;
+            int r = in.open(path, MAGIC, sizeof(K), valueSize());
+            if(r != 0)
+                return r;
+            scratch.reserve(in.header.count);
+            K key;
+            for(uint64_t i = 0; i < in.header.count; i++) {
+                memcpy(&key, in.keys + i * sizeof(K), sizeof(K));
+                if(!scratch.empty() && !comp(scratch.back()->key, key)) {
+                    for(Node* node : scratch)
+                        destroyNode(node);
+                    scratch.clear();
+                    return -2;
+                }
+                Node* node = createNode(key);
+                if constexpr(!std::is_void<V>::value)
+                    memcpy(&node->value, in.values + i * sizeof(V), sizeof(V));
+                scratch.push_back(node);
+            }
+            size = max_size = scratch.size();
+            root = build(size);
+            return 0;
+        }
+
+        /**
+         * @brief Inserts a sorted range of keys. Small batches are inserted one by one.
+         *          Larger batches are merged with the flattened tree and rebuilt once, in O(n + m).
+         * 
+         * @param first 
+         * @param last 
+         * @return int number of keys that were not already in the tree.
+         */
+        template<typename It>
+        int insert_batch(It first, It last) {
+            long start = statistics.now();
+            int m = std::distance(first, last);
+            int inserted = 0;
+            if((double) m * log2(size + 2) < size) {
+                for(; first != last; ++first)
+                    inserted += insert(*first) == 1;
+                return inserted;
+            }
+
+            finish_rebuild();
+            scratch.clear();
+            flatten(root);
+            std::vector<Node*> merged;
+            merged.reserve(scratch.size() + m);
+            size_t i = 0;
+            for(; first != last; ++first) {
+                while(i < scratch.size() && comp(scratch[i]->key, *first))
+                    merged.push_back(scratch[i++]);
+                if(i < scratch.size() && !comp(*first, scratch[i]->key))
+                    continue;
+                if(!merged.empty() && !comp(merged.back()->key, *first))
+                    continue;
+                merged.push_back(createNode(*first));
+                inserted++;
+            }
+            merged.insert(merged.end(), scratch.begin() + i, scratch.end());
+            scratch.swap(merged);
+            size = max_size = scratch.size();
+            root = build(size);
+            statistics.rebuild(size, start);
+            return inserted;
         }
 
         /**
@@ -187,118 +985,798 @@ class ScapegoatTree {
          * @param key 
          * @return int - 1 = success, -1 duplicate key. 
          */
-        int insert(K key) {
-            Node* node = new Node(key);
+        int insert(const K& key) {
+            return insert_key(key, key);
+        }
+
+        /**
+         * @brief insert moving key into the new node.
+         */
+        int insert(K&& key) {
+            return insert_key(key, std::move(key));
+        }
+
+        /**
+         * @brief Set mode: inserts a key constructed from args. A single argument of type K, or of a type a transparent
+         *          Compare can compare with K, is searched for as is and the key is only constructed in a new node.
+         *          Otherwise the key is constructed first and moved into the node if it is missing.
+         * 
+         * @param args arguments of a K constructor.
+         * @return int - 1 = success, -1 duplicate key. 
+         */
+        template<typename... Args>
+        int emplace(Args&&... args) {
+            static_assert(std::is_void<V>::value, "emplace makes keys of a set, use try_emplace for a map");
+            if constexpr(sizeof...(Args) == 1 && (probe<Args>() && ...)) {
+                return insert_key(args..., std::forward<Args>(args)...);
+            } else {
+                K key (std::forward<Args>(args)...);
+                return insert_key(key, std::move(key));
+            }
+        }
+
+        /**
+         * @brief Map mode: inserts key with value, or assigns value if the key exists.
+         * 
+         * @param key 
+         * @param value 
+         * @return int - 1 = inserted, 0 = assigned.
+         */
+        template<typename W = V>
+        int insert_or_assign(const K& key, W&& value) {
+            return assign_key(key, key, std::forward<W>(value));
+        }
+
+        template<typename W = V>
+        int insert_or_assign(K&& key, W&& value) {
+            return assign_key(key, std::move(key), std::forward<W>(value));
+        }
+
+        /**
+         * @brief Map mode: inserts key with a value constructed in place from args, if the key is missing.
+         *          Nothing is allocated or constructed for a key that is already there.
+         * 
+         * @param key 
+         * @param args arguments of a V constructor.
+         * @return int - 1 = inserted, -1 duplicate key, its value unchanged.
+         */
+        template<typename... Args>
+        int try_emplace(const K& key, Args&&... args) {
+            static_assert(!std::is_void<V>::value, "try_emplace needs a map (V not void)");
+            return insert_key(key, key, std::in_place, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        int try_emplace(K&& key, Args&&... args) {
+            static_assert(!std::is_void<V>::value, "try_emplace needs a map (V not void)");
+            return insert_key(key, std::move(key), std::in_place, std::forward<Args>(args)...);
+        }
+
+        /**
+         * @brief Map mode: searches for key.
+         * 
+         * @param key 
+         * @return V* to the value, or null if the key was not found.
+         */
+        template<typename W = V>
+        W* find(const K& key) {
+            static_assert(!std::is_void<V>::value, "find needs a map (V not void)");
+            int comps = 0;
+            Node* node = lookup(key, comps);
+            return node ? &node->value : nullptr;
+        }
+
+        /**
+         * @brief Map mode: find with any key type a transparent Compare can compare with K.
+         */
+        template<typename Q, typename W = V, typename C = Compare, typename = typename C::is_transparent>
+        W* find(const Q& key) {
+            static_assert(!std::is_void<V>::value, "find needs a map (V not void)");
+            int comps = 0;
+            Node* node = lookup(key, comps);
+            return node ? &node->value : nullptr;
+        }
+
+        /**
+         * @brief Number of keys smaller than key, in O(log n). Needs SubtreeSizes.
+         * 
+         * @param key 
+         * @return int 
+         */
+        int rank(const K& key) {
+            static_assert(SubtreeSizes, "rank needs SubtreeSizes = true");
+            int r = 0;
+            Node* tmp = root;
+            while(tmp) {
+                if(!comp(tmp->key, key)) {
+                    tmp = tmp->left;
+                } else {
+                    r += size_of(tmp->left) + 1;
+                    tmp = tmp->right;
+                }
+            }
+            return r;
+        }
+
+        /**
+         * @brief The i'th smallest key, counting from 0, in O(log n). Needs SubtreeSizes.
+         * 
+         * @param i 
+         * @return K* or null if i is out of range.
+         */
+        K* select(int i) {
+            static_assert(SubtreeSizes, "select needs SubtreeSizes = true");
+            Node* tmp = root;
+            while(tmp) {
+                int left = size_of(tmp->left);
+                if(i < left) {
+                    tmp = tmp->left;
+                } else if(i == left) {
+                    return &tmp->key;
+                } else {
+                    i -= left + 1;
+                    tmp = tmp->right;
+                }
+            }
+            return nullptr;
+        }
+
+    private:
+        /**
+         * @brief Checks if emplace can search with an argument of type A instead of a constructed key.
+         */
+        template<typename A>
+        static constexpr bool probe() {
+            return std::is_same<std::decay_t<A>, K>::value || IsTransparent<Compare>::value;
+        }
+
+        /**
+         * @brief Inserts a node constructed from args if no key is equivalent to key. The node is made
+         *          and the insert logged for an incremental rebuild only then.
+         * 
+         * @return int - 1 = success, -1 duplicate key. 
+         */
+        template<typename Q, typename... Args>
+        int insert_key(const Q& key, Args&&... args) {
+            Node* node;
+            int result = insert_node(key, [&]() { return log_insert(createNode(std::forward<Args>(args)...)); }, node);
+            advance();
+            return result;
+        }
+
+        /**
+         * @brief Logs a node insert_node is about to link in, for a running incremental rebuild.
+         * 
+         * @param made 
+         * @return Node* made.
+         */
+        Node* log_insert(Node* made) {
+            log_update(made->key, LogEntry::INSERT);
+            return made;
+        }
+
+        /**
+         * @brief insert_or_assign, made is what the new node's key is constructed from.
+         */
+        template<typename KK, typename W>
+        int assign_key(const K& key, KK&& made, W&& value) {
+            static_assert(!std::is_void<V>::value, "insert_or_assign needs a map (V not void)");
+            log_update(key, LogEntry::INSERT);
+            Node* node;
+            int result = insert_node(key, [&]() {
+                return createNode(std::forward<KK>(made), std::in_place, std::forward<W>(value));
+            }, node);
+            if(result != 1)
+                node->value = std::forward<W>(value);
+            advance();
+            return result == 1 ? 1 : 0;
+        }
+
+        /**
+         * @brief Finds the node with a key equivalent to key, with one three-way comparison per node.
+         * 
+         * @param key 
+         * @param comps increased by the number of comparisons.
+         * @return Node* or null if there is none.
+         */
+        template<typename Q>
+        Node* lookup(const Q& key, int& comps) {
+            Node* tmp = root;
+            while(tmp) {
+                comps++;
+                if constexpr(CheapLess<Compare, Q, K>::value) {
+                    //std::less on numbers is <, written out so the child is picked with a conditional move
+                    if(key == tmp->key)
+                        break;
+                    tmp = key < tmp->key ? tmp->left : tmp->right;
+                } else {
+                    int c = three_way(comp, key, tmp->key);
+                    if(c == 0)
+                        break;
+                    tmp = c < 0 ? tmp->left : tmp->right;
+                }
+            }
+            return tmp;
+        }
+
+        /**
+         * @brief insert, also handing back the node that holds key.
+         * 
+         * @param key 
+         * @param make returns the new node, only called if key is missing.
+         * @param node set to the new node, or to the existing node for a duplicate key.
+         * @return int - 1 = success, -1 duplicate key. 
+         */
+        template<typename Q, typename Make>
+        int insert_node(const Q& key, Make make, Node*& node) {
             Node* tmp = nullptr;
             Node* n = root;
-            std::stack<Node*> ancestorStack; 
+            int c = 0;
+            Node* path[PATH];
+            int depth = 0;
             while(n) {
                 tmp = n;
-                ancestorStack.push(tmp);
-                if (node->key < n->key)
-                    n = n->left;
-                else if (node->key == n->key) {
-                    delete node;
+                path[depth++ % PATH] = n;
+                c = three_way(comp, key, n->key);
+                if(c == 0) {
+                    node = n;
                     return -1;
                 }
-                else
-                    n = n->right;
+                n = c < 0 ? n->left : n->right;
             }
+            node = make();
             if(!tmp)
                 root = node;
-            else if(node->key < tmp->key)
+            else if(c < 0)
                 tmp->left = node;
-            else if(node->key > tmp->key)
+            else
                 tmp->right = node;
             size++;
             max_size = std::max(max_size, size);
+            statistics.insert();
+            if constexpr(SubtreeSizes) {
+                for(Node* a = root; a != node; a = comp(node->key, a->key) ? a->left : a->right)
+                    a->count++;
+            }
 
             //check if too deep
-            if((int)(ancestorStack.size()) > h_alpha()) {
-                while(!ancestorStack.empty()) {
-                    Node* n = ancestorStack.top();
-                    int n_size = size_of(n);
-                    //find scapegoat node
-                    if(!(size_of(n->left) <= alpha * n_size && size_of(n->right) <= alpha * n_size)) {
-                        ancestorStack.pop();
-                        restructs++;
-                        if(ancestorStack.empty()) { //root is scapegoat
-                            Node* w = new Node(0);
-                            root = flatten_wrapper(root, w);
-                            root = build(n_size, root)->left;
+            lastDepth = depth;
+            if(depth > h_alpha()) {
+                //walk up from the new node, reusing the size of the child on the path
+                //so only the sibling subtrees are counted.
+                Node* child = node;
+                int child_size = 1;
+                int distance = 0;
+                //while an incremental rebuild runs only rebuilds up to incrementalStep nodes can be done,
+                //so larger subtrees need not be counted
+                int limit = incrementalStep > 0 && job.phase != RebuildJob::IDLE ? incrementalStep + 1 : size;
+                for(int d = depth - 1; d >= 0; d--) {
+                    Node* n = ancestor_at(path, depth, d, node->key);
+                    int sibling_size = size_upto(n->left == child ? n->right : n->left, limit);
+                    int n_size = child_size + sibling_size + 1;
+                    if(n_size > limit)
+                        return 1;
+                    distance++;
+                    //find scapegoat node. Postponed rebuilds leave deep paths whose lowest unbalanced node
+                    //is small, so incremental mode takes the first node too high for its size instead.
+                    bool scapegoat = incrementalStep > 0 ? distance > floor(log(n_size) / log(1/alpha))
+                        : !(child_size <= alpha * n_size && sibling_size <= alpha * n_size);
+                    if(scapegoat) {
+                        if(defer_rebuild(n, n_size))
+                            return 1;
+                        if(d == 0) { //root is scapegoat
+                            root = rebuild(root);
                             max_size = size;
-                            w->left = nullptr;
-                            delete w;
                             return 1;
                         }
-                        Node* ancestor = ancestorStack.top();
+                        Node* ancestor = ancestor_at(path, depth, d - 1, node->key);
                         int i = leftOrRightChild(ancestor, n);
 
                         //Rebuild tree:
-                        Node* w = new Node(0);
-                        n = flatten_wrapper(n, w);
-                        if(i == 1) { // left
-                            ancestor->left = n;
-                        } else if (i == 0) {// right
-                            ancestor->right = n;
-                        }
-                        n = build(n_size, n)->left;
+                        n = rebuild(n);
                         if(i == 1) { // left
                             ancestor->left = n;
                         } else if (i == 0) {// right
                             ancestor->right = n;
                         }
                         max_size = size;
-                        w->left = nullptr;
-                        delete w;
                         return 1;
                     }
-                    ancestorStack.pop();
+                    child = n;
+                    child_size = n_size;
                 }
             }
             return 1;
         }
 
+    public:
         /**
          * @brief Remove wrapper. Finds the node with the matching key and deletes it using the remove_recusive function.
          * 
          * @param key 
          * @return int - 0 = fail, 1 = sucess. 
          */
-        int remove(K key) {
+        int remove(const K& key) {
+            return remove_key(key);
+        }
+
+        /**
+         * @brief remove with any key type a transparent Compare can compare with K.
+         */
+        template<typename Q, typename C = Compare, typename = typename C::is_transparent>
+        int remove(const Q& key) {
+            return remove_key(key);
+        }
+
+    private:
+        template<typename Q>
+        int remove_key(const Q& key) {
             int tmp_size = size;
-            remove_recursive(root, key);
-            if(size == tmp_size) return 0;
-            if(size < alpha * max_size) {
+            if constexpr(std::is_same<Q, K>::value) {
+                log_update(key, LogEntry::REMOVE);
+            } else if(job.active()) {
+                //the log keeps a K, take the one of the node
+                int comps = 0;
+                if(Node* node = lookup(key, comps))
+                    log_update(node->key, LogEntry::REMOVE);
+            }
+            root = remove_recursive(root, key);
+            if(size == tmp_size) {
+                advance();
+                return 0;
+            }
+            statistics.remove();
+            if(size < alpha * max_size && !defer_rebuild(root, size)) {
                 //rebuild tree
-                Node* w = new Node(0);
-                root = flatten_wrapper(root, w);
-                root = build(size, root)->left;
+                root = rebuild(root);
                 max_size = size;
-                w->left = nullptr;
-                delete w;
             } 
+            advance();
             return 1;
         }
-        
+
+    public:
+        /**
+         * @brief Lets rebuilds of at least PARALLEL_CUTOFF nodes build the balanced tree on up to threads threads.
+         *          Flattening stays sequential. Also used by bulk_load, load, split, join and freeze.
+         * 
+         * @param threads 1 (the default) builds on the calling thread only.
+         */
+        void setRebuildThreads(int threads) {
+            rebuildThreads = std::max(1, threads);
+        }
+
+        /**
+         * @brief Opt-in incremental rebuilding, for a bound on the rebuild work of a single update.
+         *          Rebuilds of more than step nodes are then done step nodes per later insert or remove:
+         *          the subtree is copied, built and swapped in while searches keep using the old one,
+         *          and updates to its keys in the meantime are logged and replayed on the copy.
+         *          Smaller rebuilds are done at once as usual. Needs memory for a copy of the subtree while it runs.
+         *          Unlike normal rebuilds, the swap replaces the nodes, so pointers from find or search_key
+         *          into the rebuilt subtree become invalid, and values written through them before the swap are lost.
+         * 
+         *          Only one such rebuild runs at a time; larger rebuilds needed meanwhile wait for it, so runs of
+         *          ascending inserts can deepen the tree for a while. The work per update is multiplied while
+         *          inserts land deeper than twice the usual height bound. A rebuild costs about three units per node
+         *          (copy, build, delete), so step is raised to at least 16. Without SubtreeSizes finding a scapegoat
+         *          still counts its subtree, so the bound on a single update needs SubtreeSizes.
+         * 
+         *          The values are copied too, so a map needs a copyable V.
+         * 
+         * @param step nodes of rebuild work per update, 0 (the default) turns it off.
+         */
+        void setIncrementalRebuild(int step) {
+            static_assert(COPIES, "incremental rebuilds copy the values, V must be copyable");
+            if(step <= 0)
+                finish_rebuild();
+            incrementalStep = step > 0 ? std::max(16, step) : 0;
+        }
+
+        /**
+         * @brief Rebuilds the whole tree into a perfectly balanced tree.
+         */
+        void rebalance() {
+            finish_rebuild();
+            root = rebuild(root);
+            max_size = size;
+        }
+
+        /**
+         * @brief Moves every key not less than key into greater, replacing its contents.
+         *          Flattens the tree once and builds both halves perfectly balanced, in O(n).
+         *          Both trees must have equal allocators, since the moved nodes are freed by greater from then on.
+         * 
+         * @param key 
+         * @param greater receives the keys >= key, another tree than this one.
+         * @return int - 0 = fail, greater is this tree or the allocators differ and nothing was moved, 1 = success.
+         */
+        int split(const K& key, ScapegoatTree& greater) {
+            if(&greater == this || alloc != greater.alloc)
+                return 0;
+            finish_rebuild();
+            greater.clear();
+            long start = statistics.now();
+            scratch.clear();
+            flatten(root);
+            size_t p = 0;
+            while(p < scratch.size() && comp(scratch[p]->key, key))
+                p++;
+            greater.scratch.assign(scratch.begin() + p, scratch.end());
+            greater.size = greater.max_size = greater.scratch.size();
+            greater.root = greater.build(greater.size);
+            size = max_size = p;
+            root = build(size);
+            statistics.rebuild(size + greater.size, start);
+            return 1;
+        }
+
+        /**
+         * @brief Moves every key of other into this tree, when all keys of one tree are smaller than all keys of the other.
+         *          Flattens both trees and builds the concatenation perfectly balanced, in O(n + m).
+         *          The allocators must be equal, since the moved nodes are freed by this tree from then on.
+         * 
+         * @param other emptied on success.
+         * @return int - 0 = fail, the key ranges overlap or the allocators differ and nothing was moved, 1 = success.
+         */
+        int join(ScapegoatTree& other) {
+            if(alloc != other.alloc)
+                return 0;
+            finish_rebuild();
+            other.finish_rebuild();
+            if(other.root == nullptr)
+                return 1;
+            if(root != nullptr) {
+                Node* max = root;
+                while(max->right)
+                    max = max->right;
+                Node* otherMax = other.root;
+                while(otherMax->right)
+                    otherMax = otherMax->right;
+                if(!comp(max->key, getMinimumKey(other.root)->key) && !comp(otherMax->key, getMinimumKey(root)->key))
+                    return 0;
+            }
+            long start = statistics.now();
+            scratch.clear();
+            bool otherFirst = root != nullptr && comp(other.getMinimumKey(other.root)->key, getMinimumKey(root)->key);
+            if(otherFirst)
+                other.flatten_into(scratch);
+            flatten(root);
+            if(!otherFirst)
+                other.flatten_into(scratch);
+            other.root = nullptr;
+            other.size = other.max_size = 0;
+            size = max_size = scratch.size();
+            root = build(size);
+            statistics.rebuild(size, start);
+            return 1;
+        }
+
+        /**
+         * @brief Moves every key of other that is not in this tree into it, like std::set::merge. Keys this tree
+         *          already has stay in other, with their values. Flattens both trees, merges the two node lists
+         *          and builds both perfectly balanced, in O(n + m). If other is small, like in insert_batch,
+         *          its nodes are inserted one by one instead, in O(m log n). Nodes are moved, not copied,
+         *          so the allocators must be equal. other is left perfectly balanced.
+         * 
+         * @param other 
+         * @return int number of keys moved, -1 = the allocators differ and nothing was moved.
+         */
+        int merge(ScapegoatTree& other) {
+            if(alloc != other.alloc)
+                return -1;
+            if(&other == this)
+                return 0;
+            other.finish_rebuild();
+            long start = statistics.now();
+            other.scratch.clear();
+            other.flatten(other.root);
+            size_t kept = 0;
+            if((double) other.size * log2(size + 2) < size) {
+                for(Node* node : other.scratch) {
+                    node->left = node->right = nullptr;
+                    if constexpr(SubtreeSizes)
+                        node->count = 1;
+                    Node* found;
+                    insert_node(node->key, [&]() { return log_insert(node); }, found);
+                    advance();
+                    if(found != node)
+                        other.scratch[kept++] = node;
+                }
+            } else {
+                finish_rebuild();
+                scratch.clear();
+                flatten(root);
+                std::vector<Node*> merged;
+                merged.reserve(scratch.size() + other.scratch.size());
+                size_t i = 0;
+                for(Node* node : other.scratch) {
+                    while(i < scratch.size() && comp(scratch[i]->key, node->key))
+                        merged.push_back(scratch[i++]);
+                    if(i < scratch.size() && !comp(node->key, scratch[i]->key))
+                        other.scratch[kept++] = node;
+                    else
+                        merged.push_back(node);
+                }
+                merged.insert(merged.end(), scratch.begin() + i, scratch.end());
+                scratch.swap(merged);
+                size = max_size = scratch.size();
+                root = build(size);
+                statistics.rebuild(size, start);
+            }
+            int moved = other.scratch.size() - kept;
+            other.scratch.resize(kept);
+            other.size = other.max_size = kept;
+            other.root = other.build(other.size);
+            return moved;
+        }
+
+        /**
+         * @brief Removes every key that is not in other. Walks both flattened trees side by side
+         *          and builds both perfectly balanced, in O(n + m).
+         * 
+         * @param other left with the same keys.
+         * @return int number of keys removed.
+         */
+        int intersect(ScapegoatTree& other) {
+            if(&other == this)
+                return 0;
+            return retain(other, true);
+        }
+
+        /**
+         * @brief Removes every key that is in other, in O(n + m) like intersect. If other is small,
+         *          its keys are removed one by one instead, in O(m log n), and other is not restructured.
+         * 
+         * @param other left with the same keys.
+         * @return int number of keys removed.
+         */
+        int subtract(ScapegoatTree& other) {
+            if(&other == this) {
+                int removed = size;
+                clear();
+                return removed;
+            }
+            if((double) other.size * log2(size + 2) < size) {
+                other.finish_rebuild();
+                int removed = 0;
+                for(iterator it = other.begin(); it != other.end(); ++it)
+                    removed += remove(*it);
+                return removed;
+            }
+            return retain(other, false);
+        }
+
+    private:
+        /**
+         * @brief Keeps the keys that are in other if inOther is true, or those that are not if it is false,
+         *          and frees the rest. See intersect and subtract.
+         */
+        int retain(ScapegoatTree& other, bool inOther) {
+            finish_rebuild();
+            other.finish_rebuild();
+            long start = statistics.now();
+            scratch.clear();
+            flatten(root);
+            other.scratch.clear();
+            other.flatten(other.root);
+            size_t j = 0, kept = 0;
+            for(size_t i = 0; i < scratch.size(); i++) {
+                Node* node = scratch[i];
+                while(j < other.scratch.size() && comp(other.scratch[j]->key, node->key))
+                    j++;
+                bool found = j < other.scratch.size() && !comp(node->key, other.scratch[j]->key);
+                if(found == inOther)
+                    scratch[kept++] = node;
+                else
+                    destroyNode(node);
+            }
+            int removed = scratch.size() - kept;
+            scratch.resize(kept);
+            size = max_size = kept;
+            root = build(size);
+            other.root = other.build(other.scratch.size());
+            other.max_size = other.size;
+            statistics.rebuild(size + other.size, start);
+            return removed;
+        }
+
+    public:
+        /**
+         * @brief Creates a read-only copy of the keys in Eytzinger layout, for read-heavy phases.
+         *          The sorted keys come from flatten, so the tree is left perfectly balanced.
+         * 
+         * @return FrozenTree<K, Compare> 
+         */
+        FrozenTree<K, Compare> freeze() {
+            finish_rebuild();
+            long start = statistics.now();
+            scratch.clear();
+            flatten(root);
+            FrozenTree<K, Compare> frozen (KeyIterator{scratch.data()}, scratch.size(), comp);
+            root = build(scratch.size());
+            statistics.rebuild(scratch.size(), start);
+            max_size = size;
+            return frozen;
+        }
+
         /**
          * @brief Searches for the node with matching key.
          * 
          * @param key 
          * @return K* to the key of the node.
          */
-        K* search_key(K key) {
-            auto tmp = root;
-            while(tmp && tmp->key != key) {
-                comps += 2;
-                if(key < tmp->key)
-                    tmp = tmp->left;
+        K* search_key(const K& key) {
+            int comps = 0;
+            Node* node = lookup(key, comps);
+            statistics.search(comps);
+            return node ? &node->key : nullptr;
+        }
+
+        /**
+         * @brief search_key with any key type a transparent Compare can compare with K, e.g. std::string_view
+         *          for std::string keys, without making a K.
+         */
+        template<typename Q, typename C = Compare, typename = typename C::is_transparent>
+        K* search_key(const Q& key) {
+            int comps = 0;
+            Node* node = lookup(key, comps);
+            statistics.search(comps);
+            return node ? &node->key : nullptr;
+        }
+
+        /**
+         * @brief Forward iterator over the keys in order. Keeps the pending ancestors in a fixed array instead of
+         *          recursing or allocating; 64 entries cover h_alpha() for any int size up to alpha = 0.7.
+         *          If a deeper tree overflows it, the oldest entries are dropped and the successor is found
+         *          again from the root when they would have been needed.
+         */
+        class iterator {
+            static const int DEPTH = 64;
+            Node* root = nullptr;
+            Node* node = nullptr;
+            Compare comp;
+            Node* stack[DEPTH];
+            int top = 0;
+            int count = 0;
+            bool truncated = false;
+
+            void push(Node* n) {
+                stack[top] = n;
+                top = (top + 1) % DEPTH;
+                if(count < DEPTH)
+                    count++;
                 else
-                    tmp = tmp->right;
+                    truncated = true;
+            }
+
+            Node* pop() {
+                top = (top + DEPTH - 1) % DEPTH;
+                count--;
+                return stack[top];
+            }
+
+            void leftmost(Node* n) {
+                while(n) {
+                    push(n);
+                    n = n->left;
+                }
+                node = count > 0 ? pop() : nullptr;
+            }
+
+            /**
+             * @brief Moves to the first key not less than key (inclusive) or greater than key.
+             */
+            void seek(const K& key, bool inclusive) {
+                top = count = 0;
+                truncated = false;
+                Node* n = root;
+                while(n) {
+                    if(inclusive ? !comp(n->key, key) : comp(key, n->key)) {
+                        push(n);
+                        n = n->left;
+                    } else {
+                        n = n->right;
+                    }
+                }
+                node = count > 0 ? pop() : nullptr;
             }
-            if(tmp == nullptr)
-                return nullptr;
-            return &(tmp->key);
+
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = K;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const K*;
+                using reference = const K&;
+
+                iterator() {}
+
+                iterator(Node* root, const Compare& comp) : root(root), comp(comp) {
+                    leftmost(root);
+                }
+
+                iterator(Node* root, const K& key, bool inclusive, const Compare& comp) : root(root), comp(comp) {
+                    seek(key, inclusive);
+                }
+
+                reference operator*() const { return node->key; }
+                pointer operator->() const { return &node->key; }
+
+                /**
+                 * @brief Map mode: the value stored with the current key.
+                 */
+                template<typename W = V>
+                W& value() const { return node->value; }
+
+                iterator& operator++() {
+                    if(node->right)
+                        leftmost(node->right);
+                    else if(count > 0)
+                        node = pop();
+                    else if(truncated)
+                        seek(node->key, false);
+                    else
+                        node = nullptr;
+                    return *this;
+                }
+
+                iterator operator++(int) {
+                    iterator tmp = *this;
+                    ++*this;
+                    return tmp;
+                }
+
+                bool operator==(const iterator& other) const { return node == other.node; }
+                bool operator!=(const iterator& other) const { return node != other.node; }
+        };
+
+        /**
+         * @brief Keys with lo <= key < hi, usable in a range-based for loop.
+         */
+        struct Range {
+            iterator first, last;
+            iterator begin() const { return first; }
+            iterator end() const { return last; }
+        };
+
+        iterator begin() {
+            return iterator(root, comp);
+        }
+
+        iterator end() {
+            return iterator();
+        }
+
+        /**
+         * @brief Finds the first key not less than key.
+         * 
+         * @param key 
+         * @return iterator, end() if there is none.
+         */
+        iterator lower_bound(const K& key) {
+            return iterator(root, key, true, comp);
+        }
+
+        /**
+         * @brief Finds the first key greater than key.
+         * 
+         * @param key 
+         * @return iterator, end() if there is none.
+         */
+        iterator upper_bound(const K& key) {
+            return iterator(root, key, false, comp);
+        }
+
+        /**
+         * @brief The keys with lo <= key < hi. Costs two searches, then amortized O(1) per key visited.
+         * 
+         * @param lo 
+         * @param hi 
+         * @return Range 
+         */
+        Range range(const K& lo, const K& hi) {
+            if(!comp(lo, hi))
+                return Range{end(), end()};
+            return Range{lower_bound(lo), lower_bound(hi)};
         }
 
         /*
@@ -312,20 +1790,22 @@ class ScapegoatTree {
             return size;
         }
 
-        int getComps() {
-            return comps;
-        }
-
-        int getRestructs() {
-            return restructs;
+        Alloc getAllocator() {
+            return Alloc(alloc);
         }
 
         /**
-         * @brief Resets the number of comparisons done in the tree.
-         *          Used for analysis.
+         * @brief Snapshot of the counters kept by StatsPolicy, plus size and height.
+         *          The height is measured by walking the tree.
+         * 
+         * @return Stats 
          */
-        void resetComps() {
-            comps = 0;
+        Stats stats() {
+            Stats s;
+            statistics.collect(s);
+            s.size = size;
+            s.height = height_of(root);
+            return s;
         }
 
         /*
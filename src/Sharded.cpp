@@ -0,0 +1,419 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "Epoch.cpp"
+#include "SkipList.cpp"
+#include "ScapegoatTree.cpp"
+
+/**
+ * @brief How Sharded talks to a container. Value is void for sets.
+ *          find returns a pointer to the value, or to the key for a set, null if the key is missing.
+ *          join leaves the container in the shape middle needs, and middle is the key at total / 2, or close to it,
+ *          of a non-empty container. make takes the container's constructor arguments and builds it with
+ *          the allocator shared by all shards, unless the arguments end with an allocator of their own.
+ */
+template<typename Container>
+struct ShardTraits;
+
+template<typename K, typename T, typename StatsPolicy, typename Compare, typename Alloc>
+struct ShardTraits<Skiplist<K, T, StatsPolicy, Compare, Alloc>> {
+    using C = Skiplist<K, T, StatsPolicy, Compare, Alloc>;
+    using Key = K;
+    using Value = T;
+    using Allocator = Alloc;
+
+    static C* make(const Alloc& shared, int levelCap, float probability = 0.5, uint64_t seed = 0x9E3779B97F4A7C15ULL,
+            const Compare& compare = Compare()) {
+        return new C(levelCap, probability, seed, compare, shared);
+    }
+    static C* make(const Alloc&, int levelCap, float probability, uint64_t seed, const Compare& compare, const Alloc& allocator) {
+        return new C(levelCap, probability, seed, compare, allocator);
+    }
+
+    static bool insert(C& c, const K& key, const T& value) { return c.insert(key, value) == 0; }
+    static bool remove(C& c, const K& key) { return c.remove(key); }
+    static const T* find(C& c, const K& key) { return c.search(key); }
+    static const K& key(const typename C::iterator& it) { return it->key; }
+    static bool join(C& c, C& other) { return c.join(other) == 1; }
+    static K middle(C& c, long) { return *c.middle_key(); }
+
+    template<typename F>
+    static void visit(const typename C::iterator& it, F& f) { f(it->key, it->data); }
+};
+
+template<typename K, typename V, bool SubtreeSizes, typename StatsPolicy, typename Compare, typename Alloc>
+struct ShardTraits<ScapegoatTree<K, V, SubtreeSizes, StatsPolicy, Compare, Alloc>> {
+    using C = ScapegoatTree<K, V, SubtreeSizes, StatsPolicy, Compare, Alloc>;
+    using Key = K;
+    using Value = V;
+    using Allocator = Alloc;
+
+    static C* make(const Alloc& shared, float alpha = 0.57, const Compare& compare = Compare()) {
+        return new C(alpha, compare, shared);
+    }
+    static C* make(const Alloc&, float alpha, const Compare& compare, const Alloc& allocator) {
+        return new C(alpha, compare, allocator);
+    }
+
+    static bool insert(C& c, const K& key) { return c.insert(key) == 1; }
+    template<typename W>
+    static bool insert(C& c, const K& key, const W& value) { return c.insert_or_assign(key, value) == 1; }
+    static bool remove(C& c, const K& key) { return c.remove(key) == 1; }
+    static auto find(C& c, const K& key) {
+        if constexpr(std::is_void<V>::value)
+            return (const K*) c.search_key(key);
+        else
+            return (const V*) c.find(key);
+    }
+    static const K& key(const typename C::iterator& it) { return *it; }
+    // join leaves c as it is when other is empty, rebuilt here so the root of a tree without sizes is the median
+    static bool join(C& c, C& other) {
+        bool rebuild = !SubtreeSizes && other.getSize() == 0;
+        if(c.join(other) != 1)
+            return false;
+        if(rebuild)
+            c.rebalance();
+        return true;
+    }
+    static K middle(C& c, long total) {
+        if constexpr(SubtreeSizes)
+            return *c.select(total / 2);
+        else
+            return c.getRoot()->key;
+    }
+
+    template<typename F>
+    static void visit(const typename C::iterator& it, F& f) {
+        if constexpr(std::is_void<V>::value)
+            f(*it);
+        else
+            f(*it, it.value());
+    }
+};
+
+/**
+ * @brief Range-sharded front-end for Skiplist or ScapegoatTree, so threads working on different key ranges
+ *          do not wait for each other. Shard i holds the keys in [boundary i - 1, boundary i) and has its own lock.
+ *
+ *          The boundaries are published as an immutable vector that is replaced when shards are rebalanced;
+ *          old vectors are freed through Epoch. An operation routes with the vector it read, locks the shard
+ *          and retries if the shard's own range, which only changes under its lock, no longer holds the key.
+ *
+ *          Every REBALANCE_CHECK changes a shard compares its size with its neighbours. When one of two neighbours
+ *          holds more than twice the keys of the other plus MIN_MOVE, both are joined and split again at their
+ *          median, using the containers' split and join (flatten and build for ScapegoatTree). The median comes from
+ *          ShardTraits::middle without walking the keys, but both shard locks are still held for O(n) in total:
+ *          a ScapegoatTree is rebuilt and a Skiplist split counts the smaller half, see getRebalanceNs.
+ *
+ *          join and split move nodes between shards, so all shards get one allocator, and the shards are left
+ *          as they are if join refuses anyway. With more than one thread that allocator is used concurrently,
+ *          so it must be thread safe, like std::allocator; ArenaAllocator's NodeArena is not.
+ *
+ * @tparam Container Skiplist<K, T, ...> or ScapegoatTree<K, V, ...>, see ShardTraits.
+ */
+template<typename Container>
+class Sharded {
+    using Traits = ShardTraits<Container>;
+    using K = typename Traits::Key;
+    using V = typename Traits::Value;
+
+    static const int REBALANCE_CHECK = 256;
+    static const long MIN_MOVE = 1024;
+
+    struct alignas(64) Shard {
+        std::mutex lock;
+        std::unique_ptr<Container> c;
+        // range, changed only while holding lock
+        K lo {}, hi {};
+        bool hasLo = false, hasHi = false;
+        int changes = 0;
+        std::atomic<long> size {0};
+
+        bool holds(const K& key) const {
+            return (!hasLo || !(key < lo)) && (!hasHi || key < hi);
+        }
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    int count;
+    std::atomic<std::vector<K>*> bounds;
+    std::mutex rebalancing;
+    std::atomic<long> rebalances {0};
+    std::atomic<long> rebalanceNs {0};
+
+    static void deleteBounds(void* p) {
+        delete static_cast<std::vector<K>*>(p);
+    }
+
+    /**
+     * @brief Locks the shard holding key and runs f on its container.
+     *
+     * @return whatever f returns.
+     */
+    template<typename F>
+    auto locked(const K& key, F f) {
+        while(true) {
+            Epoch::Guard guard;
+            const std::vector<K>& b = *bounds.load(std::memory_order_acquire);
+            int i = std::upper_bound(b.begin(), b.end(), key) - b.begin();
+            Shard& s = shards[i];
+            std::lock_guard<std::mutex> lock (s.lock);
+            if(s.holds(key))
+                return f(s, i);
+        }
+    }
+
+    /**
+     * @brief Counts a size change of shard i, which must be locked by the caller.
+     * @return true if its neighbours should be checked for skew.
+     */
+    bool changed(Shard& s, long d) {
+        s.size.fetch_add(d, std::memory_order_relaxed);
+        return ++s.changes % REBALANCE_CHECK == 0;
+    }
+
+    static bool skewed(long a, long b) {
+        return std::max(a, b) > 2 * std::min(a, b) + MIN_MOVE;
+    }
+
+    /**
+     * @brief Rebalances shard i with a skewed neighbour. Skipped if another thread is rebalancing already.
+     */
+    void check(int i) {
+        long size = shards[i].size.load(std::memory_order_relaxed);
+        int j = -1;
+        if(i > 0 && skewed(shards[i - 1].size.load(std::memory_order_relaxed), size))
+            j = i - 1;
+        else if(i + 1 < count && skewed(size, shards[i + 1].size.load(std::memory_order_relaxed)))
+            j = i;
+        if(j < 0 || !rebalancing.try_lock())
+            return;
+        rebalance(j);
+        rebalancing.unlock();
+    }
+
+    /**
+     * @brief Moves keys between shards j and j + 1 so both hold half of them. Needs the rebalancing lock.
+     *          Locks j before j + 1, the only place that holds two shard locks.
+     */
+    void rebalance(int j) {
+        Shard& a = shards[j];
+        Shard& b = shards[j + 1];
+        std::lock_guard<std::mutex> lockA (a.lock);
+        std::lock_guard<std::mutex> lockB (b.lock);
+        long total = a.size.load() + b.size.load();
+        if(total == 0 || !skewed(a.size.load(), b.size.load()))
+            return;
+        auto start = std::chrono::steady_clock::now();
+        if(!Traits::join(*a.c, *b.c))
+            return;
+        K middle = Traits::middle(*a.c, total);
+        // split refuses for the same reasons as join, which accepted these two
+        a.c->split(middle, *b.c);
+        a.size.store(a.c->getSize());
+        b.size.store(b.c->getSize());
+        a.hi = b.lo = middle;
+
+        std::vector<K>* next = new std::vector<K>(*bounds.load());
+        (*next)[j] = middle;
+        std::vector<K>* old = bounds.exchange(next, std::memory_order_acq_rel);
+        Epoch::retire(old, deleteBounds);
+        rebalances.fetch_add(1, std::memory_order_relaxed);
+        rebalanceNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    }
+
+    public:
+        /**
+         * @brief Construct a sharded container with boundaries.size() + 1 shards.
+         *
+         * @param boundaries sorted, distinct first keys of shards 1, 2, ...
+         * @param args passed to the constructor of every shard's container, e.g. levelCap and probability for a Skiplist.
+         *          Without an allocator at the end, the shards share one default constructed allocator.
+         */
+        template<typename... Args>
+        Sharded(std::vector<K> boundaries, Args... args) : count(boundaries.size() + 1) {
+            shards.reset(new Shard[count]);
+            typename Traits::Allocator shared;
+            for(int i = 0; i < count; i++) {
+                shards[i].c.reset(Traits::make(shared, args...));
+                if(i > 0) {
+                    shards[i].hasLo = true;
+                    shards[i].lo = boundaries[i - 1];
+                }
+                if(i + 1 < count) {
+                    shards[i].hasHi = true;
+                    shards[i].hi = boundaries[i];
+                }
+            }
+            bounds.store(new std::vector<K>(std::move(boundaries)));
+        }
+
+        ~Sharded() {
+            delete bounds.load();
+        }
+
+        Sharded(const Sharded&) = delete;
+        Sharded& operator=(const Sharded&) = delete;
+
+        /**
+         * @brief Boundaries for n shards splitting [lo, hi) of an integral key type evenly.
+         */
+        static std::vector<K> even(int n, K lo, K hi) {
+            std::vector<K> b;
+            for(int i = 1; i < n; i++)
+                b.push_back(lo + (K) ((long double) (hi - lo) * i / n));
+            b.erase(std::unique(b.begin(), b.end()), b.end());
+            return b;
+        }
+
+        /**
+         * @brief Inserts key into a set.
+         * @return true if it was added, false if it was there already.
+         */
+        bool insert(const K& key) {
+            bool skew = false;
+            int shard;
+            bool added = locked(key, [&](Shard& s, int i) {
+                shard = i;
+                bool result = Traits::insert(*s.c, key);
+                skew = result && changed(s, 1);
+                return result;
+            });
+            if(skew)
+                check(shard);
+            return added;
+        }
+
+        /**
+         * @brief Inserts key with value into a map, or assigns value if the key exists.
+         * @return true if the key was added.
+         */
+        template<typename W>
+        bool insert(const K& key, const W& value) {
+            bool skew = false;
+            int shard;
+            bool added = locked(key, [&](Shard& s, int i) {
+                shard = i;
+                bool result = Traits::insert(*s.c, key, value);
+                skew = result && changed(s, 1);
+                return result;
+            });
+            if(skew)
+                check(shard);
+            return added;
+        }
+
+        /**
+         * @brief Removes key.
+         * @return true if it was found.
+         */
+        bool remove(const K& key) {
+            bool skew = false;
+            int shard;
+            bool removed = locked(key, [&](Shard& s, int i) {
+                shard = i;
+                bool result = Traits::remove(*s.c, key);
+                skew = result && changed(s, -1);
+                return result;
+            });
+            if(skew)
+                check(shard);
+            return removed;
+        }
+
+        /**
+         * @brief Searches for key.
+         * @return true if it was found.
+         */
+        bool search(const K& key) {
+            return locked(key, [&](Shard& s, int) { return Traits::find(*s.c, key) != nullptr; });
+        }
+
+        /**
+         * @brief Map mode: searches for key and copies its value into out, since the value may move once the shard is unlocked.
+         * @return true if it was found.
+         */
+        template<typename W>
+        bool search(const K& key, W& out) {
+            static_assert(!std::is_void<V>::value, "search with a value needs a map");
+            return locked(key, [&](Shard& s, int) {
+                auto value = Traits::find(*s.c, key);
+                if(value)
+                    out = *value;
+                return value != nullptr;
+            });
+        }
+
+        /**
+         * @brief Calls f(key) for a set, f(key, value) for a map, on every element in key order.
+         *          Each shard is locked while it is visited and rebalancing waits until the end, so every key
+         *          present for the whole call is visited exactly once. It is not a snapshot across shards.
+         */
+        template<typename F>
+        void for_each(F f) {
+            std::lock_guard<std::mutex> hold (rebalancing);
+            for(int i = 0; i < count; i++) {
+                std::lock_guard<std::mutex> lock (shards[i].lock);
+                for(auto it = shards[i].c->begin(); it != shards[i].c->end(); ++it)
+                    Traits::visit(it, f);
+            }
+        }
+
+        /**
+         * @brief for_each restricted to lo <= key < hi. Only visits the shards overlapping the range.
+         */
+        template<typename F>
+        void for_each_in(const K& lo, const K& hi, F f) {
+            if(!(lo < hi))
+                return;
+            std::lock_guard<std::mutex> hold (rebalancing);
+            const std::vector<K>& b = *bounds.load(std::memory_order_acquire);
+            int first = std::upper_bound(b.begin(), b.end(), lo) - b.begin();
+            for(int i = first; i < count && (i == 0 || b[i - 1] < hi); i++) {
+                std::lock_guard<std::mutex> lock (shards[i].lock);
+                auto range = shards[i].c->range(lo, hi);
+                for(auto it = range.begin(); it != range.end(); ++it)
+                    Traits::visit(it, f);
+            }
+        }
+
+        /*
+        * ---- Getters:
+        */
+        long getSize() {
+            long total = 0;
+            for(int i = 0; i < count; i++)
+                total += shards[i].size.load(std::memory_order_relaxed);
+            return total;
+        }
+
+        int getShards() {
+            return count;
+        }
+
+        long getShardSize(int i) {
+            return shards[i].size.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Number of times keys were moved between two shards.
+         */
+        long getRebalances() {
+            return rebalances.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Total time both shard locks were held by rebalancing, in nanoseconds.
+         */
+        long getRebalanceNs() {
+            return rebalanceNs.load(std::memory_order_relaxed);
+        }
+};
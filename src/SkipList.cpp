@@ -1,28 +1,89 @@
+#pragma once
+
 #include <vector>
+#include <new>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+
+#include "Stats.cpp"
+#include "Snapshot.cpp"
+#include "NodeArena.cpp"
+#include "Compare.cpp"
 
-template <typename K, typename T>
+/**
+ * @brief Skiplist mapping K to T.
+ * 
+ * @tparam K key.
+ * @tparam T data.
+ * @tparam StatsPolicy NoStats, FullStats or ConcurrentStats, see Stats.cpp.
+ * @tparam Compare strict weak order on keys. If it has is_transparent (like std::less<>), search and remove
+ *          also take other key types it can compare, e.g. std::string_view for std::string keys.
+ * @tparam Alloc allocator for the nodes, e.g. std::pmr::polymorphic_allocator or ArenaAllocator (see NodeArena.cpp).
+ *          It is rebound to a unit of node alignment, nodes take a whole number of units depending on their level.
+ */
+template <typename K, typename T, typename StatsPolicy = NoStats, typename Compare = std::less<K>,
+    typename Alloc = std::allocator<char>>
 class Skiplist {
+    public:
+        /**
+         * @brief Key and data of an element, what iterators point to.
+         */
+        struct Entry {
+            K key;
+            T data;
+        };
 
+    private:
     int size = 0;
     float probability = 0.5;
     int MAXLEVEL = 0;
     int levelCap;
 
-    struct Node {
-        K key;
-        T data;
-        std::vector<Node*> next;
+    //random level generation, see randomLevel()
+    uint64_t rngState;
+    int levelBits = 0;
+    double invLogProbability = 0;
+
+    /**
+     * @brief A node and its tower of forward pointers share one allocation.
+     *          The level + 1 pointers are stored directly after the node.
+     *          Level 0 links every node in key order, which is what iterators walk.
+     */
+    struct alignas(void*) Node : Entry {
+        int level = 0;
+
+        Node() = default;
+
+        template<typename KK, typename... Args>
+        Node(int level, KK&& key, Args&&... args) : Entry{std::forward<KK>(key), T(std::forward<Args>(args)...)}, level(level) {}
 
-        ~Node() {
-            if(next.at(0))
-                delete next.at(0);
+        Node** next() {
+            return reinterpret_cast<Node**>(this + 1);
         }
     };
 
+    /**
+     * @brief What the allocator hands out, a node takes units(level) of them.
+     */
+    struct alignas(Node) Unit {
+        unsigned char bytes[alignof(Node)];
+    };
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Unit>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+    //with an arena and nodes without destructors, clear and the destructor just release the arena
+    static constexpr bool RELEASES = ArenaOwner<NodeAlloc>::value && std::is_trivially_destructible<Entry>::value;
+
+    NodeAlloc alloc;
+    Compare comp;
+
     Node* head;
 
-    //used for analysis
-    int comps = 0;
+    StatsPolicy statistics;
+
+    static constexpr char MAGIC[] = "SKIPLIST";
 
     /**
      * @brief l(size) function from the article. Used to determine the amount of levels for lists.
@@ -31,6 +92,13 @@ class Skiplist {
         return log(size) / log(1/probability);
     }
 
+    /**
+     * @brief Number of Units a node of level takes, the node and its tower rounded up.
+     */
+    static size_t units(int level) {
+        return (sizeof(Node) + (level + 1) * sizeof(Node*) + sizeof(Unit) - 1) / sizeof(Unit);
+    }
+
     /**
      * @brief Create a Node object.
      * 
@@ -38,38 +106,194 @@ class Skiplist {
      * @return Node* 
      */
     Node* createNode(int level) {
-        Node* node = new Node();
-        node->next = std::vector<Node*> (level + 1);
+        void* memory = NodeTraits::allocate(alloc, units(level));
+        Node* node = new (memory) Node();
+        node->level = level;
+        for(int i = 0; i <= level; i++)
+            node->next()[i] = nullptr;
         return node;
     }
 
     /**
-     * @brief Create a Node object with parameters.
+     * @brief Create a Node object with its key, and data constructed from args.
      * 
-     * @param key 
-     * @param data 
      * @param level 
+     * @param key 
+     * @param args 
      * @return Node* 
      */
-    Node* createNode(K key, T data, int level) {
-        Node* node = new Node();
-        node->data = data;
-        node->key = key;
-        node->next = std::vector<Node*> (level + 1);
+    template<typename KK, typename... Args>
+    Node* createNode(int level, KK&& key, Args&&... args) {
+        void* memory = NodeTraits::allocate(alloc, units(level));
+        Node* node = new (memory) Node(level, std::forward<KK>(key), std::forward<Args>(args)...);
+        for(int i = 0; i <= level; i++)
+            node->next()[i] = nullptr;
         return node;
     }
 
     /**
-     * @brief Generates a random level for a node
+     * @brief Frees every node, head included, by releasing the arena, if the nodes come from an arena
+     *          only this list uses and need no destructor calls.
+     * @return true if it did.
+     */
+    bool release_nodes() {
+        if constexpr(RELEASES) {
+            if(alloc.exclusive()) {
+                alloc.resource().release();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Destroys a node created by createNode. Does not touch the nodes it points to.
+     * 
+     * @param node 
+     */
+    void destroyNode(Node* node) {
+        int level = node->level;
+        node->~Node();
+        NodeTraits::deallocate(alloc, reinterpret_cast<Unit*>(node), units(level));
+    }
+
+    /**
+     * @brief xorshift64* step on the list's own generator state.
+     * @return 64 random bits.
+     */
+    uint64_t nextRandom() {
+        rngState ^= rngState >> 12;
+        rngState ^= rngState << 25;
+        rngState ^= rngState >> 27;
+        return rngState * 0x2545F4914F6CDD1DULL;
+    }
+
+    /**
+     * @brief Generates a random level for a node from a single draw.
+     *          P(level >= i) = probability^i, capped at levelCap.
+     *          For probability = 1/2^k the level is the number of trailing zero bits divided by k,
+     *          otherwise it is found by inverting the geometric distribution.
      * @return random level - int.
      */
     int randomLevel() {
-        int level = 0;
-        float r = ((double) std::rand() / (RAND_MAX));
-        while(r < probability && level < levelCap) {
-            level++;
+        int level;
+        if(levelBits > 0) {
+            level = __builtin_ctzll(nextRandom() | (1ULL << 63)) / levelBits;
+        } else if(probability <= 0) {
+            level = 0;
+        } else if(probability >= 1) {
+            level = levelCap;
+        } else {
+            double u = ((nextRandom() >> 11) + 1) * 0x1.0p-53; // uniform in (0, 1]
+            double l = log(u) * invLogProbability;
+            level = l < levelCap ? (int) l : levelCap;
+        }
+        return std::min(level, levelCap);
+    }
+
+    /**
+     * @brief Finds the last node before key on level 0.
+     * 
+     * @param key 
+     * @param inclusive if true, nodes with a key equal to key count as before it.
+     * @return Node* the last node with a smaller (or equal) key, head if there is none.
+     */
+    Node* predecessor(const K& key, bool inclusive) {
+        Node* current = head;
+        for(int i = MAXLEVEL; i >= 0; i--) {
+            Node* next;
+            while((next = current->next()[i]) != nullptr && (comp(next->key, key) || (inclusive && !comp(key, next->key))))
+                current = next;
         }
-        return level;
+        return current;
+    }
+
+    /**
+     * @brief Appends a node after the last node of every level of its tower. Used to build a list from sorted keys.
+     * 
+     * @param tail last node per level, updated.
+     * @param key larger than every key in the list.
+     * @param data 
+     * @param level 
+     * @return Node* the new node.
+     */
+    Node* append(std::vector<Node*>& tail, const K& key, const T& data, int level) {
+        Node* node = createNode(level, key, data);
+        for(int i = 0; i <= level; i++) {
+            tail[i]->next()[i] = node;
+            tail[i] = node;
+        }
+        size++;
+        return node;
+    }
+
+    /**
+     * @brief Links an existing node after the last node of every level of its tower, like append.
+     *          Used to rebuild the list from its own nodes in key order.
+     * 
+     * @param tail last node per level, updated.
+     * @param node 
+     */
+    void relink(Node** tail, Node* node) {
+        for(int i = 0; i <= node->level; i++) {
+            tail[i]->next()[i] = node;
+            tail[i] = node;
+        }
+    }
+
+    /**
+     * @brief Ends every level after the last node relinked and sets MAXLEVEL like a built list.
+     */
+    void end_relink(Node** tail) {
+        for(int i = 0; i <= levelCap; i++)
+            tail[i]->next()[i] = nullptr;
+        MAXLEVEL = builtMaxLevel();
+    }
+
+    /**
+     * @brief Keeps the elements whose keys are in other if inOther is true, or those whose keys are not
+     *          if it is false, and frees the rest. Walks level 0 of both lists side by side and relinks
+     *          the kept nodes, in O(n + m). See intersect and subtract.
+     */
+    int retain(Skiplist& other, bool inOther) {
+        Node* tail[64];
+        std::fill(tail, tail + levelCap + 1, head);
+        Node* b = other.head->next()[0];
+        int removed = 0;
+        for(Node* a = head->next()[0]; a != nullptr; ) {
+            Node* next = a->next()[0];
+            while(b != nullptr && comp(b->key, a->key))
+                b = b->next()[0];
+            bool found = b != nullptr && !comp(a->key, b->key);
+            if(found == inOther) {
+                relink(tail, a);
+            } else {
+                destroyNode(a);
+                removed++;
+            }
+            a = next;
+        }
+        size -= removed;
+        end_relink(tail);
+        return removed;
+    }
+
+    /**
+     * @brief MAXLEVEL for a list built by append, one below l(size) like the list would have after inserts.
+     */
+    int builtMaxLevel() {
+        return size > 0 ? std::max(0, std::min((int) floor(l()) - 1, levelCap - 1)) : 0;
+    }
+
+    /**
+     * @brief Finds the last node of the list. The list must not be empty.
+     */
+    Node* predecessor_last() {
+        Node* current = head;
+        for(int i = MAXLEVEL; i >= 0; i--)
+            while(current->next()[i] != nullptr)
+                current = current->next()[i];
+        return current;
     }
 
     /**
@@ -79,84 +303,457 @@ class Skiplist {
     void increaseMaxLevel() {
         int level = MAXLEVEL;
         Node* p = head;
-        Node* q = p->next.at(level);
+        Node* q = p->next()[level];
 
         while(q != nullptr) {
-            if((int)(q->next.size() - 1) > level) {
-                p->next.resize(level + 2);
-                p->next.at(level + 1) = q;
+            if(q->level > level) {
+                p->next()[level + 1] = q;
                 p = q;
             }
-            q = q->next.at(level);
+            q = q->next()[level];
         }        
-        p->next.resize(level + 2);
-        p->next.at(level + 1) = nullptr;
+        p->next()[level + 1] = nullptr;
         MAXLEVEL++;
-        head->next.resize(MAXLEVEL + 1);
-        head->next.at(MAXLEVEL) = p;
     }
 
     public:
-        Skiplist(int levelCap, float probability=0.5) {
-            // std::srand(time(NULL)); // used to get unique random seed for later calls.
-            this->levelCap = levelCap;
+        /**
+         * @brief Construct a new Skiplist.
+         * 
+         * @param levelCap highest level a node can get, at most 63.
+         * @param probability chance of a node reaching the next level.
+         * @param seed seed of the list's level generator. Lists with the same seed and operations get the same shape.
+         * @param compare order of the keys.
+         * @param allocator allocator the nodes come from.
+         */
+        Skiplist(int levelCap, float probability=0.5, uint64_t seed=0x9E3779B97F4A7C15ULL,
+            const Compare& compare=Compare(), const Alloc& allocator=Alloc()) : alloc(allocator), comp(compare) {
+            //bounded so inserts and removes can keep their path in a fixed array on the stack
+            this->levelCap = std::min(levelCap, 63);
             this->probability=probability;
-            //Creates a head node with no key/value.
-            head = createNode(MAXLEVEL);
+            rngState = seed ? seed : 0x9E3779B97F4A7C15ULL; // xorshift state must not be zero
+            if(probability > 0 && probability < 1) {
+                int exponent;
+                if(frexp(probability, &exponent) == 0.5 && exponent <= 0)
+                    levelBits = 1 - exponent; // probability = 1/2^levelBits
+                invLogProbability = 1 / log(probability);
+            }
+            //Creates a head node with no key/value, tall enough for any node.
+            head = createNode(levelCap);
         };
 
+        /**
+         * @brief Construct a Skiplist from a range of (key, data) pairs sorted by key, see bulk_load.
+         */
+        template<typename It>
+        Skiplist(It first, It last, int levelCap, float probability=0.5, uint64_t seed=0x9E3779B97F4A7C15ULL,
+            const Compare& compare=Compare(), const Alloc& allocator=Alloc()) : Skiplist(levelCap, probability, seed, compare, allocator) {
+            bulk_load(first, last);
+        }
+
         ~Skiplist() {
-            delete head;
+            if(release_nodes())
+                return;
+            clear();
+            destroyNode(head);
         }
 
         /**
-         * @brief Inserts a node into the skiplist and increasing maxlevel if necessary.
+         * @brief Removes every element, walking level 0 once. With an ArenaAllocator of its own and trivially
+         *          destructible keys and data, the arena is released instead and a new head is made, in O(pages).
+         */
+        void clear() {
+            size = 0;
+            MAXLEVEL = 0;
+            if(release_nodes()) {
+                head = createNode(levelCap);
+                return;
+            }
+            Node* current = head->next()[0];
+            while(current != nullptr) {
+                Node* next = current->next()[0];
+                destroyNode(current);
+                current = next;
+            }
+            for(int i = 0; i <= levelCap; i++)
+                head->next()[i] = nullptr;
+        }
+
+        /**
+         * @brief Replaces the contents with a range of (key, data) pairs sorted by key, in O(n).
+         *          Nodes are appended left to right on every level of their tower, and MAXLEVEL is set once at the end.
+         *          For equal keys the last pair wins, like repeated inserts.
          * 
-         * @param key 
-         * @param data 
-         * @return int result of operation (-1, 0, 1).
+         * @param first iterator to pairs with .first = key and .second = data.
+         * @param last 
          */
-        int insert(K key, T data) {
-            std::vector<Node*> update (levelCap);
+        template<typename It>
+        void bulk_load(It first, It last) {
+            clear();
+            std::vector<Node*> tail (levelCap + 1, head);
+            Node* previous = nullptr;
+            for(; first != last; ++first) {
+                if(previous != nullptr && !comp(previous->key, first->first)) {
+                    previous->data = first->second;
+                    continue;
+                }
+                previous = append(tail, first->first, first->second, randomLevel());
+            }
+            MAXLEVEL = builtMaxLevel();
+        }
 
-            Node* current = head;
+        /**
+         * @brief Like bulk_load, but the range does not have to be sorted. Sorts a copy first, in O(n log n).
+         * 
+         * @param first iterator to pairs with .first = key and .second = data.
+         * @param last 
+         */
+        template<typename It>
+        void bulk_load_unsorted(It first, It last) {
+            std::vector<std::pair<K, T>> sorted;
+            for(; first != last; ++first)
+                sorted.emplace_back(first->first, first->second);
+            std::stable_sort(sorted.begin(), sorted.end(),
+                [this](const std::pair<K, T>& a, const std::pair<K, T>& b) { return comp(a.first, b.first); });
+            bulk_load(sorted.begin(), sorted.end());
+        }
 
-            // Find the place to insert:
-            for(int i = MAXLEVEL; i >= 0; i--) {
-                if(current != nullptr) {
-                    while(current->next.at(i) != nullptr && current->next.at(i)->key < key) { 
-                        current = current->next.at(i);
-                    }
+        /**
+         * @brief Writes the elements to a snapshot file, see SnapshotHeader. K and T must be trivially copyable.
+         * 
+         * @param path 
+         * @param levels also store the level of every node, so load restores the exact shape.
+         * @return int - 0 = success, -1 = the file could not be written.
+         */
+        int save(const char* path, bool levels = true) {
+            static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<T>::value,
+                "save needs trivially copyable keys and data");
+            SnapshotWriter out (path);
+            out.put(SnapshotHeader::make(MAGIC, sizeof(K), sizeof(T), size, levels ? SnapshotHeader::LEVELS : 0, MAXLEVEL));
+            for(Node* node = head->next()[0]; node != nullptr; node = node->next()[0])
+                out.put(node->key);
+            for(Node* node = head->next()[0]; node != nullptr; node = node->next()[0])
+                out.put(node->data);
+            if(levels) {
+                for(Node* node = head->next()[0]; node != nullptr; node = node->next()[0]) {
+                    unsigned char level = node->level;
+                    out.put(level);
                 }
-                update.at(i) = current;
             }
-            if(current != nullptr)
-                current = current->next.at(0);
+            return out.close();
+        }
 
-            // update value of key if it already exists
-            if(current != nullptr && key == current->key) {
-                current->data = data;
+        /**
+         * @brief Replaces the contents with a snapshot written by save, in O(n). The file is memory mapped
+         *          and the nodes are appended in order like bulk_load. Stored levels are used if the file has them,
+         *          otherwise new random levels are drawn.
+         * 
+         * @param path 
+         * @return int - 0 = success, -1 = the file could not be read, -2 = not a valid snapshot of this list type.
+         *          The list is empty after a failure.
+         */
+        int load(const char* path) {
+            static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<T>::value,
+                "load needs trivially copyable keys and data");
+            clear();
+            SnapshotReader in;
+            int r = in.open(path, MAGIC, sizeof(K), sizeof(T));
+            if(r != 0)
+                return r;
+            std::vector<Node*> tail (levelCap + 1, head);
+            Node* previous = nullptr;
+            K key;
+            T data;
+            for(uint64_t i = 0; i < in.header.count; i++) {
+                memcpy(&key, in.keys + i * sizeof(K), sizeof(K));
+                memcpy(&data, in.values + i * sizeof(T), sizeof(T));
+                if(previous != nullptr && !comp(previous->key, key)) {
+                    clear();
+                    return -2;
+                }
+                previous = append(tail, key, data, in.levels ? std::min<int>(in.levels[i], levelCap) : randomLevel());
+            }
+            MAXLEVEL = in.levels ? std::min<int>(in.header.maxLevel, levelCap) : builtMaxLevel();
+            return 0;
+        }
+
+        /**
+         * @brief Moves every element with a key not less than key into greater, replacing its contents.
+         *          Takes O(log n + min(k, n - k)) expected, k the number of elements kept, so up to linear:
+         *          each level is cut after the last node before key in O(log n), but no node knows how many
+         *          follow it, so the sizes are found by counting the kept and the moved part in step until
+         *          the shorter one ends. Each half then gets the levels its size needs, like after removes.
+         *          Both lists must have the same levelCap, and equal allocators since the moved nodes are freed
+         *          by greater from then on.
+         * 
+         * @param key 
+         * @param greater receives the elements with keys >= key, another list than this one.
+         * @return int - 0 = fail, greater is this list or the level caps or allocators differ and nothing was moved,
+         *          1 = success.
+         */
+        int split(const K& key, Skiplist& greater) {
+            if(&greater == this || greater.levelCap != levelCap || alloc != greater.alloc)
+                return 0;
+            greater.clear();
+            Node* current = head;
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                while(current->next()[i] != nullptr && comp(current->next()[i]->key, key))
+                    current = current->next()[i];
+                greater.head->next()[i] = current->next()[i];
+                current->next()[i] = nullptr;
+            }
+            // the levels above MAXLEVEL are rebuilt by increaseMaxLevel before they are used, see join.
+            Node* kept = head->next()[0];
+            Node* moved = greater.head->next()[0];
+            int steps = 0;
+            while(kept != nullptr && moved != nullptr) {
+                kept = kept->next()[0];
+                moved = moved->next()[0];
+                steps++;
+            }
+            greater.size = moved == nullptr ? steps : size - steps;
+            size -= greater.size;
+            greater.MAXLEVEL = std::min(MAXLEVEL, greater.builtMaxLevel());
+            MAXLEVEL = std::min(MAXLEVEL, builtMaxLevel());
+            return 1;
+        }
+
+        /**
+         * @brief Moves every element of other into this list, when all keys of one list are smaller than all keys of the other.
+         *          Links the last node of the lower list to the first node of the upper one on every level,
+         *          and the levels only the taller list has from the few top nodes of the other, in O(log n) expected.
+         *          The joined list gets the levels its size needs. Both lists must have the same levelCap, and equal allocators since
+         *          the moved nodes are freed by this list from then on.
+         * 
+         * @param other emptied on success.
+         * @return int - 0 = fail, the key ranges overlap, the level caps or allocators differ and nothing was moved,
+         *          1 = success.
+         */
+        int join(Skiplist& other) {
+            if(other.levelCap != levelCap || alloc != other.alloc)
+                return 0;
+            if(other.size == 0)
                 return 1;
+            if(size > 0) {
+                Node* last = predecessor_last();
+                Node* otherLast = other.predecessor_last();
+                bool otherAfter = comp(last->key, other.head->next()[0]->key);
+                if(!otherAfter && !comp(otherLast->key, head->next()[0]->key))
+                    return 0;
+                if(!otherAfter) {
+                    // keep the lower list in this one: swap the towers of the two heads.
+                    for(int i = 0; i <= levelCap; i++)
+                        std::swap(head->next()[i], other.head->next()[i]);
+                    std::swap(size, other.size);
+                    std::swap(MAXLEVEL, other.MAXLEVEL);
+                }
+                // tail: last node of the lower list per level, first: first node of the upper list per level.
+                Node* tail[64];
+                Node* first[64];
+                Node* current = head;
+                for(int i = MAXLEVEL; i >= 0; i--) {
+                    while(current->next()[i] != nullptr)
+                        current = current->next()[i];
+                    tail[i] = current;
+                }
+                // levels up to both MAXLEVELs are complete in both lists. Above, the part of the list with fewer
+                // levels is linked from its level below, which only has a few nodes there.
+                int full = std::max(MAXLEVEL, other.MAXLEVEL);
+                for(int i = 0; i <= full; i++) {
+                    if(i > MAXLEVEL) {
+                        tail[i] = head;
+                        for(Node* q = head->next()[i - 1]; q != first[i - 1]; q = q->next()[i - 1]) {
+                            if(q->level >= i) {
+                                tail[i]->next()[i] = q;
+                                tail[i] = q;
+                            }
+                        }
+                    }
+                    if(i <= other.MAXLEVEL) {
+                        first[i] = other.head->next()[i];
+                    } else {
+                        first[i] = nullptr;
+                        Node* p = nullptr;
+                        for(Node* q = first[i - 1]; q != nullptr; q = q->next()[i - 1]) {
+                            if(q->level < i)
+                                continue;
+                            if(p == nullptr)
+                                first[i] = q;
+                            else
+                                p->next()[i] = q;
+                            p = q;
+                        }
+                        if(p != nullptr)
+                            p->next()[i] = nullptr;
+                    }
+                    tail[i]->next()[i] = first[i];
+                }
+                MAXLEVEL = full;
             } else {
-                int generatedLevel = randomLevel();
-                Node* node = createNode(key, data, generatedLevel);
-                if(head->next.at(0) == nullptr) { // empty list
-                    for(int i = node->next.size()-1; i >= 0; i--)
-                        head->next.at(i) = node;
+                for(int i = 0; i <= levelCap; i++)
+                    head->next()[i] = other.head->next()[i];
+                MAXLEVEL = other.MAXLEVEL;
+            }
+            size += other.size;
+            // as many levels as inserts would have given the joined list
+            while(MAXLEVEL < builtMaxLevel())
+                increaseMaxLevel();
+            for(int i = 0; i <= levelCap; i++)
+                other.head->next()[i] = nullptr;
+            other.size = 0;
+            other.MAXLEVEL = 0;
+            return 1;
+        }
+
+        /**
+         * @brief Moves every element of other whose key is not in this list into it, like std::map::merge.
+         *          Elements with keys this list already has stay in other. Walks level 0 of both lists and relinks
+         *          the towers of both in key order, in O(n + m). If other is small, like in ScapegoatTree::insert_batch,
+         *          its nodes are inserted one by one instead, in O(m log n). Nodes are moved, not copied,
+         *          so both lists must have the same levelCap and equal allocators.
+         * 
+         * @param other 
+         * @return int number of elements moved, -1 = the level caps or allocators differ and nothing was moved.
+         */
+        int merge(Skiplist& other) {
+            if(other.levelCap != levelCap || alloc != other.alloc)
+                return -1;
+            if(&other == this)
+                return 0;
+            Node* tail[64];
+            Node* otherTail[64];
+            std::fill(tail, tail + levelCap + 1, head);
+            std::fill(otherTail, otherTail + levelCap + 1, other.head);
+            Node* a = head->next()[0];
+            Node* b = other.head->next()[0];
+            int moved = 0;
+            if((double) other.size * log2(size + 2) < size) {
+                while(b != nullptr) {
+                    Node* next = b->next()[0];
+                    if(insert_with(b->key, [](Node*) {}, [&](int) { return b; }) == 0)
+                        moved++;
+                    else
+                        relink(otherTail, b);
+                    b = next;
+                }
+                other.size -= moved;
+                other.end_relink(otherTail);
+                return moved;
+            }
+            while(b != nullptr) {
+                Node* next = b->next()[0];
+                while(a != nullptr && comp(a->key, b->key)) {
+                    Node* after = a->next()[0];
+                    relink(tail, a);
+                    a = after;
+                }
+                if(a != nullptr && !comp(b->key, a->key)) {
+                    relink(otherTail, b);
                 } else {
-                    for(int i = 0; i <= std::min(generatedLevel, MAXLEVEL); i++) {    
-                        node->next.at(i) = update.at(i)->next.at(i);
-                        update.at(i)->next.at(i) = node;
-                    }
+                    relink(tail, b);
+                    moved++;
                 }
-                size++;
-                // check to see if maxlevel should increase.
-                if(floor(l()) > MAXLEVEL + 1)
-                    increaseMaxLevel();
+                b = next;
+            }
+            while(a != nullptr) {
+                Node* after = a->next()[0];
+                relink(tail, a);
+                a = after;
+            }
+            size += moved;
+            other.size -= moved;
+            end_relink(tail);
+            other.end_relink(otherTail);
+            return moved;
+        }
 
+        /**
+         * @brief Removes every element whose key is not in other, in O(n + m).
+         * 
+         * @param other not changed.
+         * @return int number of elements removed.
+         */
+        int intersect(Skiplist& other) {
+            if(&other == this)
                 return 0;
+            return retain(other, true);
+        }
+
+        /**
+         * @brief Removes every element whose key is in other, in O(n + m). If other is small,
+         *          its keys are removed one by one instead, in O(m log n).
+         * 
+         * @param other not changed.
+         * @return int number of elements removed.
+         */
+        int subtract(Skiplist& other) {
+            if(&other == this) {
+                int removed = size;
+                clear();
+                return removed;
+            }
+            if((double) other.size * log2(size + 2) < size) {
+                int removed = 0;
+                for(Node* node = other.head->next()[0]; node != nullptr; node = node->next()[0])
+                    removed += remove_key(node->key);
+                return removed;
             }
-            return -1;
+            return retain(other, false);
+        }
+
+        /**
+         * @brief Inserts a node into the skiplist and increasing maxlevel if necessary.
+         * 
+         * @param key 
+         * @param data 
+         * @return int result of operation (-1, 0, 1).
+         */
+        int insert(const K& key, const T& data) {
+            return insert_with(key, [&](Node* node) { node->data = data; },
+                [&](int level) { return createNode(level, key, data); });
+        }
+
+        /**
+         * @brief insert moving key and data into the list instead of copying them.
+         */
+        int insert(K&& key, T&& data) {
+            return insert_with(key, [&](Node* node) { node->data = std::move(data); },
+                [&](int level) { return createNode(level, std::move(key), std::move(data)); });
+        }
+
+        /**
+         * @brief Inserts key with data constructed in place from args, if the key is missing.
+         *          Neither the node nor the data is made for a key that is already there.
+         * 
+         * @param key 
+         * @param args arguments of a T constructor.
+         * @return int - 0 = inserted, 1 = key already present, its data unchanged.
+         */
+        template<typename... Args>
+        int try_emplace(const K& key, Args&&... args) {
+            return insert_with(key, [](Node*) {},
+                [&](int level) { return createNode(level, key, std::forward<Args>(args)...); });
+        }
+
+        template<typename... Args>
+        int try_emplace(K&& key, Args&&... args) {
+            return insert_with(key, [](Node*) {},
+                [&](int level) { return createNode(level, std::move(key), std::forward<Args>(args)...); });
+        }
+
+        /**
+         * @brief Inserts an element made from args, like std::map::emplace, if its key is missing.
+         *          The Entry is constructed first, so the key can be searched for, and moved into the node,
+         *          which is only made for a new key. Use try_emplace to construct the data only when it is needed.
+         *
+         * @param args initializers of an Entry: key and data, or an Entry.
+         * @return int - 0 = inserted, 1 = key already present, its data unchanged.
+         */
+        template<typename... Args>
+        int emplace(Args&&... args) {
+            Entry entry {std::forward<Args>(args)...};
+            return insert_with(entry.key, [](Node*) {},
+                [&](int level) { return createNode(level, std::move(entry.key), std::move(entry.data)); });
         }
 
         /**
@@ -166,31 +763,99 @@ class Skiplist {
          * @return true if element was removed
          * @return false if the element was not found.
          */
-        bool remove(K key) {
-            std::vector<Node*> update (levelCap);
-            Node* current = head; 
+        bool remove(const K& key) {
+            return remove_key(key);
+        }
+
+        /**
+         * @brief remove with any key type a transparent Compare can compare with K.
+         */
+        template<typename Q, typename C = Compare, typename = typename C::is_transparent>
+        bool remove(const Q& key) {
+            return remove_key(key);
+        }
+
+        /**
+         * @brief Searches the skiplist for a key and returns its value.
+         * 
+         * @param key 
+         * @return T* or null if no element with key was found.
+         */
+        T* search(const K& key) {
+            return search_key(key);
+        }
+
+        /**
+         * @brief search with any key type a transparent Compare can compare with K, e.g. std::string_view
+         *          for std::string keys, without making a K.
+         */
+        template<typename Q, typename C = Compare, typename = typename C::is_transparent>
+        T* search(const Q& key) {
+            return search_key(key);
+        }
+
+    private:
+        /**
+         * @brief Finds the place for key. Calls found(node) if the key is there,
+         *          otherwise links in make(level) on the levels of its tower and increases maxlevel if necessary.
+         *          make can also hand back an existing node with a tower of its own, see merge.
+         * 
+         * @return int - 0 = inserted, 1 = found.
+         */
+        template<typename Found, typename Make>
+        int insert_with(const K& key, Found found, Make make) {
+            Node* update[64];
+
+            Node* current = head;
 
             // Find the place to insert:
             for(int i = MAXLEVEL; i >= 0; i--) {
-                if(current != nullptr) {
-                    while(current->next.at(i) != nullptr && current->next.at(i)->key < key) { 
-                        current = current->next.at(i);
-                    }
-                }
-                update.at(i) = current;
+                while(current->next()[i] != nullptr && comp(current->next()[i]->key, key))
+                    current = current->next()[i];
+                update[i] = current;
+            }
+            current = current->next()[0];
+
+            // update value of key if it already exists
+            if(current != nullptr && !comp(key, current->key)) {
+                found(current);
+                return 1;
             }
-            if(current != nullptr)
-                current = current->next.at(0);
+            int generatedLevel = randomLevel();
+            Node* node = make(generatedLevel);
+            for(int i = 0; i <= std::min(node->level, MAXLEVEL); i++) {
+                node->next()[i] = update[i]->next()[i];
+                update[i]->next()[i] = node;
+            }
+            size++;
+            statistics.insert();
+            // check to see if maxlevel should increase.
+            if(floor(l()) > MAXLEVEL + 1)
+                increaseMaxLevel();
+
+            return 0;
+        }
+
+        template<typename Q>
+        bool remove_key(const Q& key) {
+            Node* update[64];
+            Node* current = head; 
 
-            if(current != nullptr && current->key == key) {
-                int j = std::min(((int)(current->next.size())-1), MAXLEVEL);
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                while(current->next()[i] != nullptr && comp(current->next()[i]->key, key))
+                    current = current->next()[i];
+                update[i] = current;
+            }
+            current = current->next()[0];
+
+            if(current != nullptr && !comp(key, current->key)) {
+                int j = std::min(current->level, MAXLEVEL);
                 for(int i = 0; i <= j; i++) {
-                    update.at(i)->next.at(i) = current->next.at(i);
+                    update[i]->next()[i] = current->next()[i];
                 }
-                for(int i = 0; i < (int)current->next.size(); i++)
-                    current->next.at(i) = nullptr;
-                delete current;
+                destroyNode(current);
                 size--;
+                statistics.remove();
                 if(size > 0 && MAXLEVEL > 0)
                     if(ceil(l()) < MAXLEVEL + 1)
                         MAXLEVEL--;
@@ -199,47 +864,282 @@ class Skiplist {
             return false;
         }
 
+        template<typename Q>
+        T* search_key(const Q& key) {
+            int comps = 0;
+            Node* current = head;
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                while(current->next()[i] != nullptr) { 
+                    comps++;
+                    if(!comp(current->next()[i]->key, key))
+                        break;
+                    current = current->next()[i];
+                }
+            }   
+            current = current->next()[0];
+
+            comps++;
+            statistics.search(comps);
+            if(current != nullptr && !comp(key, current->key))
+                return &(current->data);
+            else
+                return nullptr;
+        }
+
+    public:
         /**
-         * @brief Searches the skiplist for a key and returns its value.
+         * @brief Saved search position: the last node before the previous key on every level.
+         *          Valid until the next remove on the list; inserts keep it usable.
+         */
+        class Finger {
+            friend class Skiplist;
+            std::vector<Node*> path;
+        };
+
+        /**
+         * @brief Creates a finger positioned at the front of the list.
+         * @return Finger 
+         */
+        Finger finger() {
+            Finger f;
+            f.path.assign(levelCap + 1, head);
+            return f;
+        }
+
+        /**
+         * @brief Searches for a key starting from the finger instead of head, and moves the finger to key.
+         *          Climbs only as many levels as the distance from the previous key needs,
+         *          so nearby keys are found in O(log d) for a distance of d elements.
          * 
          * @param key 
+         * @param finger from finger(), updated to the new position.
          * @return T* or null if no element with key was found.
          */
-        T* search(K key) {
-            Node* current = head;
-            for(int i = MAXLEVEL; i >= 0; i--) {
-                if(current != nullptr) {
-                    while(current->next.at(i) != nullptr) { 
-                        comps++;
-                        if(!(current->next.at(i)->key < key))
-                            break;
-                        current = current->next.at(i);
-                    }
+        T* search(const K& key, Finger& finger) {
+            Node** path = finger.path.data();
+            int comps = 0;
+            int i = 0;
+            if(path[0] != head && !comp(path[0]->key, key)) {
+                // key is at or before the finger: climb until the saved node is before key.
+                while(i < MAXLEVEL && path[i] != head && !comp(path[i]->key, key))
+                    i++;
+                if(path[i] != head && !comp(path[i]->key, key))
+                    path[i] = head;
+            } else {
+                // key is after the finger: climb while the next level can still move forward.
+                while(i < MAXLEVEL && path[i + 1]->next()[i + 1] != nullptr && comp(path[i + 1]->next()[i + 1]->key, key))
+                    i++;
+            }
+            Node* current = path[i];
+            for(; i >= 0; i--) {
+                while(current->next()[i] != nullptr) {
+                    comps++;
+                    if(!comp(current->next()[i]->key, key))
+                        break;
+                    current = current->next()[i];
                 }
-            }   
-            if(current != nullptr)
-                current = current->next.at(0);
+                path[i] = current;
+            }
+            current = current->next()[0];
 
             comps++;
-            if(current != nullptr && current->key == key)
+            statistics.search(comps);
+            if(current != nullptr && !comp(key, current->key))
                 return &(current->data);
             else
                 return nullptr;
         }
 
         /**
-         * @brief Get the number of comparisons.
-         * @return int 
+         * @brief Searches for n independent keys at once. Up to 16 searches are interleaved: each step of a search
+         *          prefetches the node it will compare against next and then moves on to the other searches,
+         *          so the cache misses of different searches overlap instead of being paid one after another.
+         * 
+         * @param keys n keys to search for.
+         * @param n 
+         * @param results receives n pointers to the data, null for keys not found.
+         */
+        void search_many(const K* keys, int n, T** results) {
+            const int LANES = 16;
+            struct Lane {
+                int index;    // position in keys, -1 if idle
+                int level;
+                Node* current;
+                Node* pending; // prefetched, compared on the next visit
+            };
+            Lane lanes[LANES];
+            int nextKey = 0;
+            int active = 0;
+            int comps = 0;
+            for(Lane& lane : lanes) {
+                lane.index = -1;
+                if(nextKey < n) {
+                    lane = {nextKey++, MAXLEVEL, head, nullptr};
+                    active++;
+                }
+            }
+            while(active > 0) {
+                for(Lane& lane : lanes) {
+                    if(lane.index < 0)
+                        continue;
+                    const K& key = keys[lane.index];
+                    if(lane.pending != nullptr) {
+                        comps++;
+                        if(comp(lane.pending->key, key)) {
+                            lane.current = lane.pending;
+                        } else if(lane.level == 0) {
+                            // done: pending is the first node not before key.
+                            results[lane.index] = !comp(key, lane.pending->key) ? &lane.pending->data : nullptr;
+                            lane = nextKey < n ? Lane{nextKey++, MAXLEVEL, head, nullptr} : Lane{-1, 0, nullptr, nullptr};
+                            active -= lane.index < 0;
+                            continue;
+                        } else {
+                            lane.level--;
+                        }
+                    }
+                    Node* next;
+                    while((next = lane.current->next()[lane.level]) == nullptr && lane.level > 0)
+                        lane.level--;
+                    if(next == nullptr) {
+                        results[lane.index] = nullptr;
+                        lane = nextKey < n ? Lane{nextKey++, MAXLEVEL, head, nullptr} : Lane{-1, 0, nullptr, nullptr};
+                        active -= lane.index < 0;
+                        continue;
+                    }
+                    __builtin_prefetch(next);
+                    lane.pending = next;
+                }
+            }
+            statistics.search(comps, n);
+        }
+
+        /**
+         * @brief Forward iterator over the elements in key order, walking level 0.
+         */
+        class iterator {
+            Node* node;
+
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = Entry;
+                using difference_type = std::ptrdiff_t;
+                using pointer = Entry*;
+                using reference = Entry&;
+
+                iterator(Node* node = nullptr) : node(node) {}
+
+                reference operator*() const { return *node; }
+                pointer operator->() const { return node; }
+
+                iterator& operator++() {
+                    node = node->next()[0];
+                    return *this;
+                }
+
+                iterator operator++(int) {
+                    iterator tmp = *this;
+                    node = node->next()[0];
+                    return tmp;
+                }
+
+                bool operator==(const iterator& other) const { return node == other.node; }
+                bool operator!=(const iterator& other) const { return node != other.node; }
+        };
+
+        /**
+         * @brief Elements with lo <= key < hi, usable in a range-based for loop.
          */
-        int getComps() {
-            return comps;
+        struct Range {
+            iterator first, last;
+            iterator begin() const { return first; }
+            iterator end() const { return last; }
+        };
+
+        iterator begin() {
+            return iterator(head->next()[0]);
+        }
+
+        iterator end() {
+            return iterator();
         }
 
         /**
-         * @brief Resets the comparison counter.
+         * @brief Finds the first element with a key not less than key.
+         * 
+         * @param key 
+         * @return iterator, end() if there is none.
          */
-        void resetComps() {
-            comps = 0;
+        iterator lower_bound(const K& key) {
+            return iterator(predecessor(key, false)->next()[0]);
+        }
+
+        /**
+         * @brief Finds the first element with a key greater than key.
+         * 
+         * @param key 
+         * @return iterator, end() if there is none.
+         */
+        iterator upper_bound(const K& key) {
+            return iterator(predecessor(key, true)->next()[0]);
+        }
+
+        /**
+         * @brief The elements with lo <= key < hi. Costs two searches, then O(1) per element visited.
+         * 
+         * @param lo 
+         * @param hi 
+         * @return Range 
+         */
+        Range range(const K& lo, const K& hi) {
+            if(!comp(lo, hi))
+                return Range{end(), end()};
+            return Range{lower_bound(lo), lower_bound(hi)};
+        }
+
+        /**
+         * @brief A key near the median, for picking a split key. Goes down from the top until a level has
+         *          at least 64 nodes and returns the middle one of that level. Those nodes are a random sample of
+         *          the list, so its rank is n / 2 give or take about n / 16. O(log n + 64 / p) expected.
+         *
+         * @return K* or null if the list is empty.
+         */
+        K* middle_key() {
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                int count = 0;
+                for(Node* node = head->next()[i]; node != nullptr; node = node->next()[i])
+                    count++;
+                if(count < 64 && i > 0)
+                    continue;
+                if(count == 0)
+                    return nullptr;
+                Node* node = head->next()[i];
+                for(int k = 0; k < count / 2; k++)
+                    node = node->next()[i];
+                return &node->key;
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Snapshot of the counters kept by StatsPolicy, plus size, the highest level in use
+         *          and the level histogram, which are measured by walking level 0.
+         * @return Stats 
+         */
+        Stats stats() {
+            Stats s;
+            statistics.collect(s);
+            s.size = size;
+            s.levels.assign(levelCap + 1, 0);
+            for(Node* node = head->next()[0]; node != nullptr; node = node->next()[0]) {
+                s.levels[node->level]++;
+                s.height = std::max(s.height, node->level + 1);
+            }
+            s.levels.resize(s.height);
+            return s;
+        }
+
+        Alloc getAllocator() {
+            return Alloc(alloc);
         }
 
         /**
@@ -256,9 +1156,9 @@ class Skiplist {
          */
         void print() {
             for (int i = MAXLEVEL; i >= 0; i--) {
-                if(head->next.at(i) != nullptr) {
+                if(head->next()[i] != nullptr) {
                     std::cout << "Layer "<< i+1 <<": ";
-                    for (Node* node = head->next.at(i); node != nullptr; node = node->next.at(i)) {
+                    for (Node* node = head->next()[i]; node != nullptr; node = node->next()[i]) {
                         std::cout << "<" << node->key <<"|"<< node->data << "> -> ";
                     }
                     std::cout << "NULL\n";
@@ -273,9 +1173,9 @@ class Skiplist {
          */
         void print_keys_only() {
             for (int i = MAXLEVEL; i >= 0; i--) {
-                if(head->next.at(i) != nullptr) {
+                if(head->next()[i] != nullptr) {
                     std::cout << "Layer "<< i+1 <<": ";
-                    for (Node* node = head->next.at(i); node != nullptr; node = node->next.at(i)) {
+                    for (Node* node = head->next()[i]; node != nullptr; node = node->next()[i]) {
                         std::cout << "<" << node->key << "> -> ";
                     }
                     std::cout << "NULL\n";
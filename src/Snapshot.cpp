@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Header of a snapshot file written by save() of Skiplist or ScapegoatTree.
+ *          It is followed by count keys, then count values (none for a set), then count one byte
+ *          skiplist levels if the LEVELS flag is set. Keys and values are stored in key order,
+ *          as raw bytes in the writer's byte order, so only trivially copyable types can be saved.
+ */
+struct SnapshotHeader {
+    static const uint32_t VERSION = 1;
+    static const uint32_t ENDIAN_MARK = 0x01020304;
+    static const uint32_t LEVELS = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t flags;
+    uint32_t maxLevel;  // skiplists only: MAXLEVEL when saved
+    uint64_t count;
+    char reserved[24];
+
+    static SnapshotHeader make(const char* magic, uint32_t keySize, uint32_t valueSize, uint64_t count, uint32_t flags = 0, uint32_t maxLevel = 0) {
+        SnapshotHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, magic, 8);
+        h.version = VERSION;
+        h.byteOrder = ENDIAN_MARK;
+        h.keySize = keySize;
+        h.valueSize = valueSize;
+        h.flags = flags;
+        h.maxLevel = maxLevel;
+        h.count = count;
+        return h;
+    }
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header must stay 64 bytes");
+
+/**
+ * @brief Writes a snapshot through a 1 MiB buffer.
+ *          Errors are remembered and reported by close(), so callers can write without checking every call.
+ */
+class SnapshotWriter {
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool failed = false;
+
+    void flush() {
+        size_t done = 0;
+        while(done < used && !failed) {
+            ssize_t w = write(fd, buffer.data() + done, used - done);
+            if(w <= 0)
+                failed = true;
+            else
+                done += w;
+        }
+        used = 0;
+    }
+
+    public:
+        SnapshotWriter(const char* path) : buffer(1 << 20) {
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            failed = fd < 0;
+        }
+
+        ~SnapshotWriter() {
+            close();
+        }
+
+        void put(const void* p, size_t n) {
+            if(used + n > buffer.size()) {
+                flush();
+                if(n > buffer.size())
+                    buffer.resize(n);
+            }
+            memcpy(buffer.data() + used, p, n);
+            used += n;
+        }
+
+        template<typename X>
+        void put(const X& x) {
+            put(&x, sizeof(X));
+        }
+
+        /**
+         * @brief Flushes and closes the file.
+         * @return int - 0 = success, -1 = the file could not be opened or written.
+         */
+        int close() {
+            if(fd >= 0) {
+                flush();
+                if(::close(fd) != 0)
+                    failed = true;
+                fd = -1;
+            }
+            return failed ? -1 : 0;
+        }
+};
+
+/**
+ * @brief Memory maps a snapshot file and checks its header before a container reads it.
+ */
+class SnapshotReader {
+    void* mapped = MAP_FAILED;
+    size_t length = 0;
+
+    public:
+        SnapshotHeader header;
+        const char* keys = nullptr;
+        const char* values = nullptr;
+        const unsigned char* levels = nullptr;
+
+        SnapshotReader() {}
+
+        ~SnapshotReader() {
+            if(mapped != MAP_FAILED)
+                munmap(mapped, length);
+        }
+
+        SnapshotReader(const SnapshotReader&) = delete;
+        SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+        /**
+         * @brief Maps path and validates it.
+         *
+         * @param path
+         * @param magic the container's magic, 8 bytes.
+         * @param keySize sizeof(K) of the loading container.
+         * @param valueSize sizeof the value type, 0 for sets.
+         * @return int - 0 = success, -1 = could not open or map the file, -2 = not a snapshot of this container type.
+         */
+        int open(const char* path, const char* magic, uint32_t keySize, uint32_t valueSize) {
+            int fd = ::open(path, O_RDONLY);
+            if(fd < 0)
+                return -1;
+            struct stat st;
+            if(fstat(fd, &st) != 0) {
+                ::close(fd);
+                return -1;
+            }
+            if(st.st_size < (off_t) sizeof(SnapshotHeader)) {
+                ::close(fd);
+                return -2;
+            }
+            length = st.st_size;
+            mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(mapped == MAP_FAILED)
+                return -1;
+            madvise(mapped, length, MADV_SEQUENTIAL);
+
+            const char* p = static_cast<const char*>(mapped);
+            memcpy(&header, p, sizeof(header));
+            if(memcmp(header.magic, magic, 8) != 0 || header.version != SnapshotHeader::VERSION
+                || header.byteOrder != SnapshotHeader::ENDIAN_MARK
+                || header.keySize != keySize || header.valueSize != valueSize || header.count > length)
+                return -2;
+            uint64_t expected = sizeof(SnapshotHeader) + header.count * (keySize + valueSize);
+            if(header.flags & SnapshotHeader::LEVELS)
+                expected += header.count;
+            if(expected != length)
+                return -2;
+            keys = p + sizeof(SnapshotHeader);
+            values = keys + header.count * keySize;
+            if(header.flags & SnapshotHeader::LEVELS)
+                levels = reinterpret_cast<const unsigned char*>(values + header.count * valueSize);
+            return 0;
+        }
+};
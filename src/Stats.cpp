@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+/**
+ * @brief Snapshot returned by stats() of every container.
+ *          The counters stay zero with NoStats. The gauges (size, height, levels) are measured
+ *          when the snapshot is taken, so they are there with every policy but cost a walk over the structure.
+ */
+struct Stats {
+    static const int BUCKETS = 32;
+
+    long searches = 0;
+    long comparisons = 0;   // key comparisons done by searches
+    long inserts = 0;       // inserts that added a key
+    long removes = 0;       // removes that found their key
+    long rebuilds = 0;
+    long rebuiltNodes = 0;
+    long rebuildNs = 0;
+    long rebuildSizes[BUCKETS] = {};    // bucket b counts rebuilds of [2^b, 2^(b+1)) nodes
+    long rebuildTimes[BUCKETS] = {};    // bucket b counts rebuilds that took [2^b, 2^(b+1)) ns
+
+    long size = 0;
+    int height = 0;             // tree height, or highest level in use for a skiplist
+    std::vector<long> levels;   // skiplists only: levels[l] nodes have a tower of height l + 1
+
+    static int bucket(long v) {
+        return v <= 1 ? 0 : std::min(BUCKETS - 1, 63 - __builtin_clzl(v));
+    }
+};
+
+/**
+ * @brief Policy that records nothing. Every hook is empty, so the calls and the clock reads compile out.
+ */
+struct NoStats {
+    static constexpr bool enabled = false;
+
+    long now() const { return 0; }
+    void search(int, int = 1) {}
+    void insert() {}
+    void remove() {}
+    void rebuild(int, long) {}
+    void collect(Stats&) const {}
+};
+
+/**
+ * @brief Counters shared by FullStats and ConcurrentStats. Count is long or std::atomic<long>.
+ */
+template<typename Count>
+struct StatCounters {
+    Count searches {0}, comparisons {0}, inserts {0}, removes {0};
+    Count rebuilds {0}, rebuiltNodes {0}, rebuildNs {0};
+    Count rebuildSizes[Stats::BUCKETS] {};
+    Count rebuildTimes[Stats::BUCKETS] {};
+
+    static void add(long& c, long v) { c += v; }
+    static void add(std::atomic<long>& c, long v) { c.fetch_add(v, std::memory_order_relaxed); }
+    static long get(const long& c) { return c; }
+    static long get(const std::atomic<long>& c) { return c.load(std::memory_order_relaxed); }
+
+    void search(int comparisons, int n) {
+        add(searches, n);
+        add(this->comparisons, comparisons);
+    }
+
+    void rebuild(int nodes, long ns) {
+        add(rebuilds, 1);
+        add(rebuiltNodes, nodes);
+        add(rebuildNs, ns);
+        add(rebuildSizes[Stats::bucket(nodes)], 1);
+        add(rebuildTimes[Stats::bucket(ns)], 1);
+    }
+
+    void addTo(Stats& s) const {
+        s.searches += get(searches);
+        s.comparisons += get(comparisons);
+        s.inserts += get(inserts);
+        s.removes += get(removes);
+        s.rebuilds += get(rebuilds);
+        s.rebuiltNodes += get(rebuiltNodes);
+        s.rebuildNs += get(rebuildNs);
+        for(int b = 0; b < Stats::BUCKETS; b++) {
+            s.rebuildSizes[b] += get(rebuildSizes[b]);
+            s.rebuildTimes[b] += get(rebuildTimes[b]);
+        }
+    }
+};
+
+inline long statsClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Policy that records every counter and both rebuild histograms, for one thread at a time.
+ */
+struct FullStats {
+    static constexpr bool enabled = true;
+    StatCounters<long> c;
+
+    long now() const { return statsClock(); }
+    void search(int comparisons, int searches = 1) { c.search(comparisons, searches); }
+    void insert() { c.inserts++; }
+    void remove() { c.removes++; }
+    void rebuild(int nodes, long start) { c.rebuild(nodes, statsClock() - start); }
+    void collect(Stats& s) const { c.addTo(s); }
+};
+
+/**
+ * @brief FullStats for containers used by many threads. Each thread counts in its own slot and stats()
+ *          adds the slots up, so up to SLOTS threads count without sharing a cache line.
+ */
+struct ConcurrentStats {
+    static constexpr bool enabled = true;
+    static const int SLOTS = 64;
+
+    struct alignas(64) Slot {
+        StatCounters<std::atomic<long>> c;
+    };
+    Slot slots[SLOTS];
+
+    static int slot() {
+        static std::atomic<int> next {0};
+        thread_local int slot = next.fetch_add(1) % SLOTS;
+        return slot;
+    }
+
+    long now() const { return statsClock(); }
+    void search(int comparisons, int searches = 1) { slots[slot()].c.search(comparisons, searches); }
+    void insert() { slots[slot()].c.add(slots[slot()].c.inserts, 1); }
+    void remove() { slots[slot()].c.add(slots[slot()].c.removes, 1); }
+    void rebuild(int nodes, long start) { slots[slot()].c.rebuild(nodes, statsClock() - start); }
+    void collect(Stats& s) const {
+        for(const Slot& slot : slots)
+            slot.c.addTo(s);
+    }
+};
@@ -0,0 +1,442 @@
+#pragma once
+
+#include <vector>
+#include <new>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+
+#include "Stats.cpp"
+
+/**
+ * @brief Unrolled skiplist mapping K to T, with the insert, remove and search of Skiplist.
+ *          A node holds a sorted block of up to BLOCK keys and their data, and one tower indexed by
+ *          the smallest key of the block. Searches walk the towers like Skiplist and then scan a single block,
+ *          so there is one allocation and one tower per block instead of per key.
+ *          A full block is split in half on insert. A block that falls below a quarter of BLOCK
+ *          is merged with its successor when both fit into three quarters of a block.
+ *
+ * @tparam K key.
+ * @tparam T data.
+ * @tparam StatsPolicy NoStats, FullStats or ConcurrentStats, see Stats.cpp.
+ * @tparam BlockBytes bytes of keys per block, four cache lines by default.
+ */
+template <typename K, typename T, typename StatsPolicy = NoStats, int BlockBytes = 256>
+class UnrolledSkiplist {
+    public:
+        static constexpr int BLOCK = std::max<int>(8, BlockBytes / sizeof(K));
+
+    private:
+    int size = 0;
+    int blocks = 0;
+    float probability = 0.5;
+    int MAXLEVEL = 0;
+    int levelCap;
+
+    //random level generation, see randomLevel()
+    uint64_t rngState;
+    int levelBits = 0;
+    double invLogProbability = 0;
+
+    /**
+     * @brief A block of count keys and their data, in key order, followed by its level + 1 forward pointers.
+     *          For integral keys the unused slots hold the largest key, so a block can be scanned in full.
+     */
+    struct alignas(void*) Node {
+        int count = 0;
+        int level = 0;
+        K keys[BLOCK];
+        T data[BLOCK];
+
+        Node** next() {
+            return reinterpret_cast<Node**>(this + 1);
+        }
+    };
+
+    Node* head;
+
+    StatsPolicy statistics;
+
+    /**
+     * @brief l(blocks), the amount of levels for the list of blocks.
+     */
+    float l() {
+        return log(blocks) / log(1/probability);
+    }
+
+    /**
+     * @brief Create an empty block.
+     *
+     * @param level level of created node.
+     * @return Node*
+     */
+    Node* createNode(int level) {
+        void* memory = ::operator new(sizeof(Node) + (level + 1) * sizeof(Node*));
+        Node* node = new (memory) Node();
+        node->level = level;
+        for(int i = 0; i <= level; i++)
+            node->next()[i] = nullptr;
+        pad(node, 0);
+        return node;
+    }
+
+    /**
+     * @brief Destroys a node created by createNode. Does not touch the nodes it points to.
+     *
+     * @param node
+     */
+    void destroyNode(Node* node) {
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    /**
+     * @brief Fills the slots from from on with the largest key, for integral keys only.
+     */
+    static void pad(Node* node, int from) {
+        if constexpr(std::is_integral<K>::value)
+            std::fill(node->keys + from, node->keys + BLOCK, std::numeric_limits<K>::max());
+    }
+
+    /**
+     * @brief Position of the first key in node that is not less than key.
+     *          Integral keys are counted over the whole padded block without branches, a loop of constant length
+     *          that the compiler vectorizes. Other keys are scanned until the first one that is not less.
+     */
+    static int position(const Node* node, const K& key) {
+        int p = 0;
+        if constexpr(std::is_integral<K>::value) {
+            for(int i = 0; i < BLOCK; i++)
+                p += node->keys[i] < key;
+        } else {
+            while(p < node->count && node->keys[p] < key)
+                p++;
+        }
+        return p;
+    }
+
+    /**
+     * @brief xorshift64* step on the list's own generator state.
+     * @return 64 random bits.
+     */
+    uint64_t nextRandom() {
+        rngState ^= rngState >> 12;
+        rngState ^= rngState << 25;
+        rngState ^= rngState >> 27;
+        return rngState * 0x2545F4914F6CDD1DULL;
+    }
+
+    /**
+     * @brief Generates a random level for a block, like Skiplist::randomLevel.
+     * @return random level - int.
+     */
+    int randomLevel() {
+        int level;
+        if(levelBits > 0) {
+            level = __builtin_ctzll(nextRandom() | (1ULL << 63)) / levelBits;
+        } else if(probability <= 0) {
+            level = 0;
+        } else if(probability >= 1) {
+            level = levelCap;
+        } else {
+            double u = ((nextRandom() >> 11) + 1) * 0x1.0p-53; // uniform in (0, 1]
+            double l = log(u) * invLogProbability;
+            level = l < levelCap ? (int) l : levelCap;
+        }
+        return std::min(level, levelCap);
+    }
+
+    /**
+     * @brief Increases the max level of the list. Should only be called when a block is added.
+     */
+    void increaseMaxLevel() {
+        int level = MAXLEVEL;
+        Node* p = head;
+        Node* q = p->next()[level];
+
+        while(q != nullptr) {
+            if(q->level > level) {
+                p->next()[level + 1] = q;
+                p = q;
+            }
+            q = q->next()[level];
+        }
+        p->next()[level + 1] = nullptr;
+        MAXLEVEL++;
+    }
+
+    /**
+     * @brief Links node into the list, on every level of its tower up to MAXLEVEL.
+     *
+     * @param node
+     * @param before node after which it goes on level i, given i.
+     */
+    template<typename Before>
+    void link(Node* node, Before before) {
+        for(int i = 0; i <= std::min(node->level, MAXLEVEL); i++) {
+            Node* p = before(i);
+            node->next()[i] = p->next()[i];
+            p->next()[i] = node;
+        }
+        blocks++;
+        if(floor(l()) > MAXLEVEL + 1)
+            increaseMaxLevel();
+    }
+
+    /**
+     * @brief Unlinks and destroys node.
+     *
+     * @param node
+     * @param before node whose successor it is on level i, given i.
+     */
+    template<typename Before>
+    void unlink(Node* node, Before before) {
+        for(int i = 0; i <= std::min(node->level, MAXLEVEL); i++)
+            before(i)->next()[i] = node->next()[i];
+        destroyNode(node);
+        blocks--;
+        if(blocks > 0 && MAXLEVEL > 0)
+            if(ceil(l()) < MAXLEVEL + 1)
+                MAXLEVEL--;
+    }
+
+    public:
+        /**
+         * @brief Construct a new UnrolledSkiplist.
+         *
+         * @param levelCap highest level a block can get, at most 63.
+         * @param probability chance of a block reaching the next level.
+         * @param seed seed of the list's level generator.
+         */
+        UnrolledSkiplist(int levelCap, float probability=0.5, uint64_t seed=0x9E3779B97F4A7C15ULL) {
+            //bounded so inserts and removes can keep their path in a fixed array on the stack
+            this->levelCap = std::min(levelCap, 63);
+            this->probability = probability;
+            rngState = seed ? seed : 0x9E3779B97F4A7C15ULL; // xorshift state must not be zero
+            if(probability > 0 && probability < 1) {
+                int exponent;
+                if(frexp(probability, &exponent) == 0.5 && exponent <= 0)
+                    levelBits = 1 - exponent; // probability = 1/2^levelBits
+                invLogProbability = 1 / log(probability);
+            }
+            head = createNode(levelCap);
+        }
+
+        ~UnrolledSkiplist() {
+            clear();
+            destroyNode(head);
+        }
+
+        UnrolledSkiplist(const UnrolledSkiplist&) = delete;
+        UnrolledSkiplist& operator=(const UnrolledSkiplist&) = delete;
+
+        /**
+         * @brief Removes every element.
+         */
+        void clear() {
+            Node* current = head->next()[0];
+            while(current != nullptr) {
+                Node* next = current->next()[0];
+                destroyNode(current);
+                current = next;
+            }
+            for(int i = 0; i <= levelCap; i++)
+                head->next()[i] = nullptr;
+            size = 0;
+            blocks = 0;
+            MAXLEVEL = 0;
+        }
+
+        /**
+         * @brief Inserts a key, or updates its data if it exists. Splits the block if it is full.
+         *
+         * @param key
+         * @param data
+         * @return int result of operation, 0 = inserted, 1 = data of an existing key updated.
+         */
+        int insert(K key, T data) {
+            Node* update[64];
+            Node* current = head;
+
+            // last block on every level whose smallest key is not greater than key:
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                while(current->next()[i] != nullptr && !(key < current->next()[i]->keys[0]))
+                    current = current->next()[i];
+                update[i] = current;
+            }
+            // keys smaller than every key go to the first block.
+            Node* node = current != head ? current : head->next()[0];
+            if(node == nullptr) {
+                node = createNode(randomLevel());
+                link(node, [&](int) { return head; });
+            }
+
+            int p = position(node, key);
+            if(p < node->count && node->keys[p] == key) {
+                node->data[p] = data;
+                return 1;
+            }
+            if(node->count == BLOCK) {
+                Node* right = createNode(randomLevel());
+                int half = BLOCK / 2;
+                std::move(node->keys + half, node->keys + BLOCK, right->keys);
+                std::move(node->data + half, node->data + BLOCK, right->data);
+                right->count = BLOCK - half;
+                node->count = half;
+                pad(node, half);
+                link(right, [&](int i) { return node->level >= i ? node : update[i]; });
+                if(p > half) {
+                    node = right;
+                    p -= half;
+                }
+            }
+            std::move_backward(node->keys + p, node->keys + node->count, node->keys + node->count + 1);
+            std::move_backward(node->data + p, node->data + node->count, node->data + node->count + 1);
+            node->keys[p] = key;
+            node->data[p] = data;
+            node->count++;
+            size++;
+            statistics.insert();
+            return 0;
+        }
+
+        /**
+         * @brief Removes a key. Unlinks its block if it becomes empty, or merges the block with its successor
+         *          if it is small and both fit.
+         *
+         * @param key
+         * @return true if element was removed
+         * @return false if the element was not found.
+         */
+        bool remove(K key) {
+            Node* update[64];
+            Node* current = head;
+
+            // last block on every level whose smallest key is less than key:
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                while(current->next()[i] != nullptr && current->next()[i]->keys[0] < key)
+                    current = current->next()[i];
+                update[i] = current;
+            }
+            Node* node = current->next()[0];
+            if(node == nullptr || key < node->keys[0])
+                node = current;
+            if(node == head)
+                return false;
+            int p = position(node, key);
+            if(p == node->count || !(node->keys[p] == key))
+                return false;
+
+            std::move(node->keys + p + 1, node->keys + node->count, node->keys + p);
+            std::move(node->data + p + 1, node->data + node->count, node->data + p);
+            node->count--;
+            pad(node, node->count);
+            size--;
+            statistics.remove();
+
+            // the block is empty only if key was its smallest, so update holds its predecessors.
+            if(node->count == 0) {
+                unlink(node, [&](int i) { return update[i]; });
+                return true;
+            }
+            Node* next = node->next()[0];
+            if(node->count < BLOCK / 4 && next != nullptr && node->count + next->count <= BLOCK * 3 / 4) {
+                std::move(next->keys, next->keys + next->count, node->keys + node->count);
+                std::move(next->data, next->data + next->count, node->data + node->count);
+                node->count += next->count;
+                unlink(next, [&](int i) { return node->level >= i ? node : update[i]; });
+            }
+            return true;
+        }
+
+        /**
+         * @brief Searches the list for a key and returns its data.
+         *
+         * @param key
+         * @return T* to the data in its block, valid until the next insert or remove, null if no element with key was found.
+         */
+        T* search(K key) {
+            int comps = 0;
+            Node* current = head;
+            for(int i = MAXLEVEL; i >= 0; i--) {
+                while(current->next()[i] != nullptr) {
+                    comps++;
+                    if(key < current->next()[i]->keys[0])
+                        break;
+                    current = current->next()[i];
+                }
+            }
+            comps++;
+            statistics.search(comps);
+            if(current == head)
+                return nullptr;
+            int p = position(current, key);
+            if(p < current->count && current->keys[p] == key)
+                return &current->data[p];
+            return nullptr;
+        }
+
+        /**
+         * @brief Calls f(key, data) on every element in key order.
+         */
+        template<typename F>
+        void for_each(F f) {
+            for(Node* node = head->next()[0]; node != nullptr; node = node->next()[0])
+                for(int i = 0; i < node->count; i++)
+                    f(node->keys[i], node->data[i]);
+        }
+
+        /**
+         * @brief Snapshot of the counters kept by StatsPolicy, plus size, the highest level in use
+         *          and the level histogram of the blocks.
+         * @return Stats
+         */
+        Stats stats() {
+            Stats s;
+            statistics.collect(s);
+            s.size = size;
+            s.levels.assign(levelCap + 1, 0);
+            for(Node* node = head->next()[0]; node != nullptr; node = node->next()[0]) {
+                s.levels[node->level]++;
+                s.height = std::max(s.height, node->level + 1);
+            }
+            s.levels.resize(s.height);
+            return s;
+        }
+
+        /**
+         * @brief Get the size of the list.
+         * @return int
+         */
+        int getSize() {
+            return size;
+        }
+
+        /**
+         * @brief Get the amount of blocks.
+         * @return int
+         */
+        int getBlocks() {
+            return blocks;
+        }
+
+        /**
+         * @brief Prints the list in layers, every block as <key key ...>.
+         */
+        void print_keys_only() {
+            for (int i = MAXLEVEL; i >= 0; i--) {
+                if(head->next()[i] != nullptr) {
+                    std::cout << "Layer "<< i+1 <<": ";
+                    for (Node* node = head->next()[i]; node != nullptr; node = node->next()[i]) {
+                        std::cout << "<";
+                        for(int j = 0; j < node->count; j++)
+                            std::cout << (j > 0 ? " " : "") << node->keys[j];
+                        std::cout << "> -> ";
+                    }
+                    std::cout << "NULL\n";
+                }
+            }
+            std::cout << " " << std::endl;
+        }
+};
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+
+/*
+*   ---- Workload benchmark used by bench.out workload.
+*   Every structure gets the same preload and the same operation stream, generated before timing starts.
+*   Allocations are read from the counters of the including file (liveBytes / allocCount in bench.cpp).
+*/
+
+/**
+ * @brief xorshift64*, so every run and every structure sees the same keys independent of std::rand.
+ */
+struct WorkloadRandom {
+    uint64_t state;
+
+    WorkloadRandom(uint64_t seed) : state(seed | 1) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    /**
+     * @brief Uniform double in (0, 1].
+     */
+    double unit() {
+        return ((next() >> 11) + 1) * 0x1.0p-53;
+    }
+};
+
+struct Operation {
+    enum Type : char { SEARCH, INSERT, REMOVE } type;
+    int key;
+};
+
+/**
+ * @brief A preload and an operation stream over the key space [0, 2n).
+ *          The preload is the even keys in random order, so about half of all searches hit.
+ */
+struct Workload {
+    std::string distribution;
+    int n = 0;
+    int reads = 0;
+    std::vector<int> preload;
+    std::vector<Operation> ops;
+
+    /**
+     * @brief Generates the workload.
+     *
+     * @param distribution uniform, zipf (s = 0.99 over a shuffled key space) or sequential (keys 0, 1, 2, ... wrapping).
+     * @param n Amount of keys to preload.
+     * @param m Amount of operations.
+     * @param reads Percentage of searches, the rest are inserts and removes in equal parts.
+     */
+    Workload(const std::string& distribution, int n, int m, int reads) : distribution(distribution), n(n), reads(reads) {
+        WorkloadRandom rng (0x9E3779B97F4A7C15ULL);
+        int space = 2 * n;
+        for(int j = 0; j < n; j++)
+            preload.push_back(2 * j);
+        shuffle(preload, rng);
+
+        std::vector<double> cdf;
+        std::vector<int> rankToKey;
+        if(distribution == "zipf") {
+            cdf.resize(space);
+            double sum = 0;
+            for(int r = 0; r < space; r++)
+                cdf[r] = sum += 1 / pow(r + 1, 0.99);
+            for(double& c : cdf)
+                c /= sum;
+            for(int k = 0; k < space; k++)
+                rankToKey.push_back(k);
+            shuffle(rankToKey, rng);
+        }
+
+        ops.resize(m);
+        for(int i = 0; i < m; i++) {
+            uint64_t r = rng.next();
+            int op = r % 100;
+            ops[i].type = op < reads ? Operation::SEARCH : op % 2 == 0 ? Operation::INSERT : Operation::REMOVE;
+            if(distribution == "zipf") {
+                int rank = std::lower_bound(cdf.begin(), cdf.end(), rng.unit()) - cdf.begin();
+                ops[i].key = rankToKey[std::min(rank, space - 1)];
+            } else if(distribution == "sequential") {
+                ops[i].key = i % space;
+            } else {
+                ops[i].key = rng.next() % space;
+            }
+        }
+    }
+
+    static void shuffle(std::vector<int>& v, WorkloadRandom& rng) {
+        for(int i = (int) v.size() - 1; i > 0; i--)
+            std::swap(v[i], v[rng.next() % (i + 1)]);
+    }
+};
+
+/*
+*   ---- One adapter per structure: insert / remove / search plus the counters the structure keeps.
+*   comps() and rebuilds() return -1 when the structure does not count them.
+*   Our structures use FullStats; its counters are a few adds per operation.
+*/
+struct SListAdapter {
+    static constexpr const char* name = "Skiplist";
+    Skiplist<int, int, FullStats> c {32, 0.5};
+    bool insert(int key) { return c.insert(key, key) == 0; }
+    bool remove(int key) { return c.remove(key); }
+    bool search(int key) { return c.search(key) != nullptr; }
+    long comps() { return c.stats().comparisons; }
+    long rebuilds() { return -1; }
+};
+
+struct UnrolledAdapter {
+    static constexpr const char* name = "UnrolledSkiplist";
+    UnrolledSkiplist<int, int, FullStats> c {32, 0.5};
+    bool insert(int key) { return c.insert(key, key) == 0; }
+    bool remove(int key) { return c.remove(key); }
+    bool search(int key) { return c.search(key) != nullptr; }
+    long comps() { return c.stats().comparisons; }
+    long rebuilds() { return -1; }
+};
+
+struct SGTAdapter {
+    static constexpr const char* name = "ScapegoatTree";
+    ScapegoatTree<int, void, false, FullStats> c {0.57};
+    bool insert(int key) { return c.insert(key) == 1; }
+    bool remove(int key) { return c.remove(key) == 1; }
+    bool search(int key) { return c.search_key(key) != nullptr; }
+    long comps() { return c.stats().comparisons; }
+    long rebuilds() { return c.stats().rebuilds; }
+};
+
+struct SGTIncrementalAdapter {
+    static constexpr const char* name = "ScapegoatTree-incremental";
+    ScapegoatTree<int, void, true, FullStats> c {0.57};
+    SGTIncrementalAdapter() { c.setIncrementalRebuild(64); }
+    bool insert(int key) { return c.insert(key) == 1; }
+    bool remove(int key) { return c.remove(key) == 1; }
+    bool search(int key) { return c.search_key(key) != nullptr; }
+    long comps() { return c.stats().comparisons; }
+    long rebuilds() { return c.stats().rebuilds; }
+};
+
+struct FatSGTAdapter {
+    static constexpr const char* name = "FatScapegoatTree";
+    FatScapegoatTree<int, FullStats> c {0.57};
+    bool insert(int key) { return c.insert(key) == 1; }
+    bool remove(int key) { return c.remove(key) == 1; }
+    bool search(int key) { return c.search_key(key) != nullptr; }
+    long comps() { return c.stats().comparisons; }
+    long rebuilds() { return c.stats().rebuilds; }
+};
+
+struct MapAdapter {
+    static constexpr const char* name = "std::map";
+    std::map<int, int> c;
+    bool insert(int key) { return c.emplace(key, key).second; }
+    bool remove(int key) { return c.erase(key) == 1; }
+    bool search(int key) { return c.find(key) != c.end(); }
+    long comps() { return -1; }
+    long rebuilds() { return -1; }
+};
+
+struct SetAdapter {
+    static constexpr const char* name = "std::set";
+    std::set<int> c;
+    bool insert(int key) { return c.insert(key).second; }
+    bool remove(int key) { return c.erase(key) == 1; }
+    bool search(int key) { return c.find(key) != c.end(); }
+    long comps() { return -1; }
+    long rebuilds() { return -1; }
+};
+
+struct WorkloadResult {
+    std::string structure, distribution;
+    int n, m, reads;
+    double nsPerOp, p50, p99, p999, max, allocsPerOp, compsPerSearch;
+    long rebuilds;
+    long hits;
+};
+
+/**
+ * @brief Runs ops on a freshly preloaded structure.
+ *
+ * @param w the workload.
+ * @param latencies if not null, every operation is timed on its own and its ns are stored here.
+ * @return long number of searches that hit and inserts/removes that changed the structure.
+ */
+template<typename Adapter>
+long runOps(Adapter& a, const Workload& w, std::vector<float>* latencies) {
+    long hits = 0;
+    for(const Operation& op : w.ops) {
+        auto start = latencies ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        switch(op.type) {
+            case Operation::SEARCH: hits += a.search(op.key); break;
+            case Operation::INSERT: hits += a.insert(op.key); break;
+            case Operation::REMOVE: hits += a.remove(op.key); break;
+        }
+        if(latencies)
+            latencies->push_back(nsSince(start));
+    }
+    return hits;
+}
+
+/**
+ * @brief Measures one structure on a workload. Throughput, allocations, comparisons and rebuilds come from
+ *          a run without per operation timers, percentiles from a second identical run that times every operation.
+ *
+ * @param w the workload.
+ * @return WorkloadResult
+ */
+template<typename Adapter>
+WorkloadResult measure(const Workload& w) {
+    WorkloadResult r;
+    int m = w.ops.size();
+    r.structure = Adapter::name;
+    r.distribution = w.distribution;
+    r.n = w.n;
+    r.m = m;
+    r.reads = w.reads;
+    {
+        Adapter a;
+        for(int key : w.preload)
+            a.insert(key);
+        long comps = a.comps(), rebuilds = a.rebuilds();
+        size_t allocs = allocCount;
+        auto start = std::chrono::steady_clock::now();
+        r.hits = runOps(a, w, nullptr);
+        r.nsPerOp = nsSince(start) / m;
+        r.allocsPerOp = (double) (allocCount - allocs) / m;
+        long searches = std::count_if(w.ops.begin(), w.ops.end(), [](const Operation& op) { return op.type == Operation::SEARCH; });
+        r.compsPerSearch = comps < 0 || searches == 0 ? -1 : (double) (a.comps() - comps) / searches;
+        r.rebuilds = rebuilds < 0 ? -1 : a.rebuilds() - rebuilds;
+    }
+    {
+        Adapter a;
+        for(int key : w.preload)
+            a.insert(key);
+        std::vector<float> latencies;
+        latencies.reserve(m);
+        runOps(a, w, &latencies);
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&](double q) { return m == 0 ? 0.0 : (double) latencies[std::min<long>(m - 1, q * m)]; };
+        r.p50 = at(0.5);
+        r.p99 = at(0.99);
+        r.p999 = at(0.999);
+        r.max = m == 0 ? 0 : latencies.back();
+    }
+    return r;
+}
+
+/**
+ * @brief Writes the results as CSV, or as a JSON array if path ends in .json. Counters a structure does not keep
+ *          are left empty in CSV and null in JSON.
+ *
+ * @param results
+ * @param path
+ * @return bool false if the file could not be opened.
+ */
+bool writeResults(const std::vector<WorkloadResult>& results, const std::string& path) {
+    std::ofstream out (path);
+    if(!out)
+        return false;
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    auto optional = [&](double v) {
+        std::ostringstream s;
+        if(v < 0)
+            s << (json ? "null" : "");
+        else
+            s << v;
+        return s.str();
+    };
+    if(json) {
+        out << "[\n";
+        for(size_t i = 0; i < results.size(); i++) {
+            const WorkloadResult& r = results[i];
+            out << "  {\"structure\": \"" << r.structure << "\", \"distribution\": \"" << r.distribution << "\""
+                << ", \"n\": " << r.n << ", \"m\": " << r.m << ", \"read_pct\": " << r.reads
+                << ", \"ns_per_op\": " << r.nsPerOp << ", \"p50_ns\": " << r.p50
+                << ", \"p99_ns\": " << r.p99 << ", \"p999_ns\": " << r.p999 << ", \"max_ns\": " << r.max
+                << ", \"allocs_per_op\": " << r.allocsPerOp
+                << ", \"comps_per_search\": " << optional(r.compsPerSearch)
+                << ", \"rebuilds\": " << optional(r.rebuilds)
+                << ", \"hits\": " << r.hits << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    } else {
+        out << "structure,distribution,n,m,read_pct,ns_per_op,p50_ns,p99_ns,p999_ns,max_ns,allocs_per_op,comps_per_search,rebuilds,hits\n";
+        for(const WorkloadResult& r : results)
+            out << r.structure << "," << r.distribution << "," << r.n << "," << r.m << "," << r.reads << ","
+                << r.nsPerOp << "," << r.p50 << "," << r.p99 << "," << r.p999 << "," << r.max << "," << r.allocsPerOp << ","
+                << optional(r.compsPerSearch) << "," << optional(r.rebuilds) << "," << r.hits << "\n";
+    }
+    return true;
+}
@@ -0,0 +1,1467 @@
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <iostream>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <malloc.h>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+
+#include "SkipList.cpp"
+#include "UnrolledSkipList.cpp"
+#include "ScapegoatTree.cpp"
+#include "FatScapegoatTree.cpp"
+#include "ConcurrentSkipList.cpp"
+#include "ConcurrentScapegoatTree.cpp"
+#include "Sharded.cpp"
+
+/*
+*   ---- Allocation counting, used to report memory per element.
+*   Bytes are counted as the usable size of each malloc block, so allocator rounding is included.
+*/
+static size_t liveBytes = 0;
+static size_t allocCount = 0;
+
+__attribute__((noinline)) void* operator new(size_t n) {
+    void* p = malloc(n);
+    if(!p)
+        throw std::bad_alloc();
+    liveBytes += malloc_usable_size(p);
+    allocCount++;
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    if(p)
+        liveBytes -= malloc_usable_size(p);
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void SListLookup(int n, int m);
+void SListBulk(int n);
+void SListMany(int n, int m);
+void SListUnrolled(int n, int m);
+void SListJoin(int n, int m);
+void SGTAscending(int n);
+void SGTRebuild(int n, int m);
+void SGTFrozen(int n, int m);
+void SGTBatch(int n, int m);
+void SGTRank(int n, int m);
+void SGTParallel(int n, int m);
+void SGTIncremental(int n, int m);
+void SGTFat(int n, int m);
+void Churn(int n, int m);
+int AllocFree(int n, int m);
+int MoveOnly(int n, int m);
+void SetOps(int n, int m);
+void RangeScan(int n, int m, int k);
+void CSListThreads(int n, int m, int reads);
+void CSGTReaders(int n, int m);
+void WorkloadBench(int n, int m, int reads, const char* distribution, const char* path);
+void StatsOverhead(int n, int m);
+void SListSnapshot(int n, int m);
+void SGTSnapshot(int n, int m);
+void ShardedThreads(int n, int m, int reads);
+double nsSince(std::chrono::steady_clock::time_point start);
+std::vector<int> shuffledKeys(int n);
+
+// uses the allocation counters and nsSince above.
+#include "Workload.cpp"
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        std::cout << "Usage: ./bench.out [Benchmark] [n] [m] [read % / scan length] [distribution] [output .csv/.json]" << std::endl;
+        return -1;
+    }
+    int n = atoi(argv[2]);
+    int m = argc > 3 ? atoi(argv[3]) : n;
+    int reads = argc > 4 ? atoi(argv[4]) : 90;
+
+    if(strcmp(argv[1], "SL-lookup") == 0)
+        SListLookup(n, m);
+    if(strcmp(argv[1], "SL-bulk") == 0)
+        SListBulk(n);
+    if(strcmp(argv[1], "SL-many") == 0)
+        SListMany(n, m);
+    if(strcmp(argv[1], "SL-unrolled") == 0)
+        SListUnrolled(n, m);
+    if(strcmp(argv[1], "SL-join") == 0)
+        SListJoin(n, m);
+    if(strcmp(argv[1], "SGT-ascending") == 0)
+        SGTAscending(n);
+    if(strcmp(argv[1], "SGT-rebuild") == 0)
+        SGTRebuild(n, m);
+    if(strcmp(argv[1], "SGT-frozen") == 0)
+        SGTFrozen(n, m);
+    if(strcmp(argv[1], "SGT-batch") == 0)
+        SGTBatch(n, m);
+    if(strcmp(argv[1], "SGT-rank") == 0)
+        SGTRank(n, m);
+    if(strcmp(argv[1], "SGT-parallel") == 0)
+        SGTParallel(n, m);
+    if(strcmp(argv[1], "SGT-incremental") == 0)
+        SGTIncremental(n, m);
+    if(strcmp(argv[1], "SGT-fat") == 0)
+        SGTFat(n, m);
+    if(strcmp(argv[1], "churn") == 0)
+        Churn(n, m);
+    if(strcmp(argv[1], "alloc-free") == 0)
+        return AllocFree(n, m) == 0 ? 0 : 1;
+    if(strcmp(argv[1], "move-only") == 0)
+        return MoveOnly(n, m) == 0 ? 0 : 1;
+    if(strcmp(argv[1], "set-ops") == 0)
+        SetOps(n, m);
+    if(strcmp(argv[1], "range") == 0)
+        RangeScan(n, m, argc > 4 ? atoi(argv[4]) : 100);
+    if(strcmp(argv[1], "CSL-threads") == 0)
+        CSListThreads(n, m, reads);
+    if(strcmp(argv[1], "CSGT-readers") == 0)
+        CSGTReaders(n, m);
+    if(strcmp(argv[1], "SL-snapshot") == 0)
+        SListSnapshot(n, m);
+    if(strcmp(argv[1], "SGT-snapshot") == 0)
+        SGTSnapshot(n, m);
+    if(strcmp(argv[1], "sharded") == 0)
+        ShardedThreads(n, m, reads);
+    if(strcmp(argv[1], "stats") == 0)
+        StatsOverhead(n, m);
+    if(strcmp(argv[1], "workload") == 0)
+        WorkloadBench(n, m, reads, argc > 5 ? argv[5] : "all", argc > 6 ? argv[6] : nullptr);
+    std::cout << std::flush;
+}
+
+/**
+ * @brief Nanoseconds elapsed since start.
+ */
+double nsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Inserts n random keys into a skiplist and performs m random searches.
+ *        Prints live heap bytes per element, allocations per insert and ns per lookup.
+ *
+ * @param n Amount of elements in the list.
+ * @param m Amount of searches.
+ */
+void SListLookup(int n, int m) {
+    std::srand(1);
+    size_t bytes = liveBytes, count = allocCount;
+    Skiplist<int, int> list (32, 0.5);
+    for(int j = 0; j < n; j++)
+        list.insert(std::rand() % n, j);
+    bytes = liveBytes - bytes;
+    count = allocCount - count;
+
+    int found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++)
+        found += list.search(std::rand() % n) != nullptr;
+    double ns = nsSince(start);
+
+    std::cout << "SL-lookup n=" << list.getSize()
+              << " bytes/element=" << (double) bytes / list.getSize()
+              << " allocs/insert=" << (double) count / n
+              << " ns/lookup=" << ns / m
+              << " found=" << found << "\n";
+}
+
+/**
+ * @brief Runs the SL-unrolled operations on one list and prints one line for it.
+ */
+template<typename List>
+void unrolledRun(const char* name, List& list, const std::vector<int>& keys, int m) {
+    int n = keys.size();
+    size_t bytes = liveBytes, count = allocCount;
+    auto start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        list.insert(key, key);
+    double insertNs = nsSince(start) / n;
+    bytes = liveBytes - bytes;
+    count = allocCount - count;
+
+    std::srand(2);
+    long found = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++)
+        found += list.search(std::rand() % (2 * n)) != nullptr;
+    double searchNs = nsSince(start) / m;
+
+    start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        list.remove(key);
+    double removeNs = nsSince(start) / n;
+
+    std::cout << "SL-unrolled " << name << " n=" << n << " bytes/element=" << (double) bytes / n
+              << " allocs/insert=" << (double) count / n << " ns/insert=" << insertNs
+              << " ns/search=" << searchNs << " ns/remove=" << removeNs << " found=" << found << "\n";
+}
+
+/**
+ * @brief Inserts n random keys into a Skiplist and an UnrolledSkiplist, does m random searches
+ *        (about half hit) and removes all keys again in another random order.
+ *        Prints bytes/element, allocations/insert and ns per insert, search and remove for both.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of searches.
+ */
+void SListUnrolled(int n, int m) {
+    std::vector<int> keys = shuffledKeys(n);
+    {
+        Skiplist<int, int> list (32, 0.5);
+        unrolledRun("Skiplist", list, keys, m);
+    }
+    {
+        UnrolledSkiplist<int, int> list (32, 0.5);
+        unrolledRun("UnrolledSkiplist", list, keys, m);
+    }
+}
+
+/**
+ * @brief Loads n sorted keys into a skiplist with n inserts, with bulk_load, and loads n random keys with
+ *        bulk_load_unsorted. Prints ns per element for each.
+ *
+ * @param n Amount of keys.
+ */
+void SListBulk(int n) {
+    std::vector<std::pair<int, int>> pairs (n);
+    for(int j = 0; j < n; j++)
+        pairs[j] = {j, j};
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        Skiplist<int, int> list (32, 0.5);
+        for(auto& p : pairs)
+            list.insert(p.first, p.second);
+    }
+    double insertNs = nsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    {
+        Skiplist<int, int> list (32, 0.5);
+        list.bulk_load(pairs.begin(), pairs.end());
+    }
+    double bulkNs = nsSince(start);
+
+    std::srand(1);
+    for(auto& p : pairs)
+        p.first = std::rand();
+    start = std::chrono::steady_clock::now();
+    {
+        Skiplist<int, int> list (32, 0.5);
+        list.bulk_load_unsorted(pairs.begin(), pairs.end());
+    }
+    double unsortedNs = nsSince(start);
+
+    std::cout << "SL-bulk n=" << n
+              << " insert ns/element=" << insertNs / n
+              << " bulk_load ns/element=" << bulkNs / n
+              << " bulk_load_unsorted ns/element=" << unsortedNs / n << "\n";
+}
+
+/**
+ * @brief Joins a list of the keys 0..n-1 with a list of the keys n..n+m-1, once into the larger list and once
+ *        into the smaller one, and compares each joined list with one built by inserting the same keys.
+ *        Prints comparisons and ns per search over all n + m keys in random order for each.
+ *
+ * @param n Amount of keys in the lower list.
+ * @param m Amount of keys in the upper list.
+ */
+void SListJoin(int n, int m) {
+    using List = Skiplist<int, int, FullStats>;
+    std::vector<int> keys (n + m);
+    for(int j = 0; j < n + m; j++)
+        keys[j] = j;
+    WorkloadRandom rng (2);
+    Workload::shuffle(keys, rng);
+    auto measure = [&](const char* name, List& list) {
+        long comps = list.stats().comparisons;
+        long found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int key : keys)
+            found += list.search(key) != nullptr;
+        double ns = nsSince(start) / keys.size();
+        std::cout << "SL-join " << name << " n=" << n << " m=" << m
+                  << " comps/search=" << (double) (list.stats().comparisons - comps) / keys.size()
+                  << " ns/search=" << ns << " found=" << found << "\n";
+    };
+    {
+        List lower (32, 0.5), upper (32, 0.5, 7);
+        for(int key : keys)
+            (key < n ? lower : upper).insert(key, key);
+        lower.join(upper);
+        measure("lower.join(upper)", lower);
+    }
+    {
+        List lower (32, 0.5), upper (32, 0.5, 7);
+        for(int key : keys)
+            (key < n ? lower : upper).insert(key, key);
+        upper.join(lower);
+        measure("upper.join(lower)", upper);
+    }
+    List fresh (32, 0.5);
+    for(int key : keys)
+        fresh.insert(key, key);
+    measure("inserted", fresh);
+}
+
+/**
+ * @brief Loads n random keys into a skiplist and looks up batches of m keys with search, finger search
+ *        and search_many. Batches are random, sorted, and clustered (runs of 64 nearby keys).
+ *        Prints ns per lookup for each combination.
+ *
+ * @param n Amount of keys, drawn from [0, 2n).
+ * @param m Amount of keys per batch.
+ */
+void SListMany(int n, int m) {
+    std::srand(1);
+    std::vector<std::pair<int, int>> pairs (n);
+    for(auto& p : pairs)
+        p = {std::rand() % (2 * n), 1};
+    Skiplist<int, int> list (32, 0.5);
+    list.bulk_load_unsorted(pairs.begin(), pairs.end());
+
+    std::vector<int> batches[3];
+    const char* names[3] = {"random", "sorted", "clustered"};
+    for(int i = 0; i < m; i++)
+        batches[0].push_back(std::rand() % (2 * n));
+    batches[1] = batches[0];
+    std::sort(batches[1].begin(), batches[1].end());
+    for(int i = 0; i < m; i++)
+        batches[2].push_back(i % 64 == 0 ? std::rand() % (2 * n) : batches[2].back() + std::rand() % 8);
+
+    std::vector<int*> results (m);
+    for(int b = 0; b < 3; b++) {
+        long found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int key : batches[b])
+            found += list.search(key) != nullptr;
+        double plainNs = nsSince(start);
+
+        auto finger = list.finger();
+        start = std::chrono::steady_clock::now();
+        for(int key : batches[b])
+            found += list.search(key, finger) != nullptr;
+        double fingerNs = nsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        list.search_many(batches[b].data(), m, results.data());
+        double manyNs = nsSince(start);
+        for(int* r : results)
+            found += r != nullptr;
+
+        std::cout << "SL-many n=" << list.getSize() << " batch=" << names[b]
+                  << " search ns=" << plainNs / m << " finger ns=" << fingerNs / m
+                  << " search_many ns=" << manyNs / m << " found=" << found << "\n";
+    }
+}
+
+/**
+ * @brief Inserts the keys 0..n-1 in ascending order into a scapegoat tree, the worst case for rebuilding.
+ *        Prints ns per insert and the number of rebuilds.
+ *
+ * @param n Amount of keys to insert.
+ */
+void SGTAscending(int n) {
+    ScapegoatTree<int, void, false, FullStats> tree (0.57);
+    auto start = std::chrono::steady_clock::now();
+    for(int j = 0; j < n; j++)
+        tree.insert(j);
+    double ns = nsSince(start);
+
+    std::cout << "SGT-ascending n=" << tree.getSize()
+              << " ns/insert=" << ns / n
+              << " restructs=" << tree.stats().rebuilds << "\n";
+}
+
+/**
+ * @brief Inserts n random keys into a scapegoat tree and rebuilds the whole tree m times.
+ *        Prints rebuild throughput in nodes per second.
+ *
+ * @param n Amount of keys to insert.
+ * @param m Amount of rebuilds.
+ */
+void SGTRebuild(int n, int m) {
+    std::srand(1);
+    ScapegoatTree<int, void, false, FullStats> tree (0.57);
+    for(int j = 0; j < n; j++)
+        tree.insert(std::rand());
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++)
+        tree.rebalance();
+    double ns = nsSince(start);
+
+    std::cout << "SGT-rebuild n=" << tree.getSize()
+              << " nodes/s=" << (double) tree.getSize() * m / (ns / 1e9)
+              << " restructs=" << tree.stats().rebuilds << "\n";
+}
+
+/**
+ * @brief Inserts n random keys into a scapegoat tree and rebuilds the whole tree m times
+ *        with 1, 2, 4, ... up to all cores building. Checks that every thread count gives the same tree.
+ *        Prints ms per rebuild, of which the sequential flatten takes about the 1 thread time minus the build.
+ *
+ * @param n Amount of keys to insert.
+ * @param m Amount of rebuilds per thread count.
+ */
+void SGTParallel(int n, int m) {
+    // at least 2, so the parallel path runs even on one core
+    int cores = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for(int t = 1; t < cores; t *= 2)
+        counts.push_back(t);
+    counts.push_back(cores);
+
+    std::srand(1);
+    ScapegoatTree<int, void, false, FullStats> tree (0.57);
+    for(int j = 0; j < n; j++)
+        tree.insert(std::rand());
+    tree.rebalance();
+    int root = tree.getRoot()->key;
+
+    for(int threads : counts) {
+        tree.setRebuildThreads(threads);
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < m; i++)
+            tree.rebalance();
+        double ns = nsSince(start);
+        std::cout << "SGT-parallel n=" << tree.getSize() << " threads=" << threads
+                  << " ms/rebuild=" << ns / m / 1e6
+                  << (tree.getRoot()->key == root ? "" : " (different tree!)") << "\n";
+    }
+}
+
+/**
+ * @brief Times every operation of a stream that forces large rebuilds: n random inserts, removes of 45% of them
+ *        (the global rebuild in remove) and n ascending inserts above all keys (root scapegoats),
+ *        once with normal and once with incremental rebuilds of m nodes per update, both with subtree sizes.
+ *        Prints the latency percentiles, the largest latency and the largest rebuild.
+ *
+ * @param n Amount of keys to insert.
+ * @param m Rebuild step of the incremental tree, see setIncrementalRebuild.
+ */
+void SGTIncremental(int n, int m) {
+    std::vector<int> keys = shuffledKeys(n);
+    for(int step : {0, m}) {
+        ScapegoatTree<int, void, true, FullStats> tree (0.57);
+        tree.setIncrementalRebuild(step);
+        std::vector<float> latencies;
+        latencies.reserve(2 * n + n / 2);
+        auto timed = [&](auto op) {
+            auto start = std::chrono::steady_clock::now();
+            op();
+            latencies.push_back(nsSince(start));
+        };
+        for(int key : keys)
+            timed([&]() { tree.insert(key); });
+        for(int i = 0; i < n * 45 / 100; i++)
+            timed([&]() { tree.remove(keys[i]); });
+        for(int j = 0; j < n; j++)
+            timed([&]() { tree.insert(2 * n + j); });
+
+        Stats stats = tree.stats();
+        int largest = 0;
+        for(int b = 0; b < Stats::BUCKETS; b++)
+            if(stats.rebuildSizes[b] > 0)
+                largest = b;
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&](double q) { return latencies[std::min<long>(latencies.size() - 1, q * latencies.size())]; };
+        std::cout << "SGT-incremental n=" << n << " step=" << step << " ns/op p50=" << at(0.5) << " p99=" << at(0.99)
+                  << " p999=" << at(0.999) << " p9999=" << at(0.9999) << " max=" << latencies.back()
+                  << " rebuilds=" << stats.rebuilds << " largest rebuild=2^" << largest << " nodes height=" << stats.height << "\n";
+    }
+}
+
+/**
+ * @brief Runs the SGT-fat operations on one tree and prints one line for it.
+ */
+template<typename Tree>
+void fatRun(const char* name, Tree& tree, const std::vector<int>& keys, int m) {
+    int n = keys.size();
+    size_t bytes = liveBytes;
+    auto start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        tree.insert(key);
+    double insertNs = nsSince(start) / n;
+    bytes = liveBytes - bytes;
+    int height = tree.stats().height;
+
+    std::srand(2);
+    long found = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++)
+        found += tree.search_key(std::rand() % (2 * n)) != nullptr;
+    double searchNs = nsSince(start) / m;
+
+    start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        tree.remove(key);
+    double removeNs = nsSince(start) / n;
+
+    std::cout << "SGT-fat " << name << " n=" << n << " bytes/key=" << (double) bytes / n << " height=" << height
+              << " ns/insert=" << insertNs << " ns/search=" << searchNs << " ns/remove=" << removeNs
+              << " found=" << found << "\n";
+}
+
+/**
+ * @brief Inserts n random keys into a ScapegoatTree and a FatScapegoatTree, does m random searches
+ *        (about half hit) and removes all keys again. Prints bytes/key (including the scratch buffers),
+ *        the height and ns per insert, search and remove for both.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of searches.
+ */
+void SGTFat(int n, int m) {
+    std::vector<int> keys = shuffledKeys(n);
+    {
+        ScapegoatTree<int> tree (0.57);
+        fatRun("ScapegoatTree", tree, keys, m);
+    }
+    {
+        FatScapegoatTree<int> tree (0.57);
+        fatRun("FatScapegoatTree", tree, keys, m);
+    }
+}
+
+/**
+ * @brief Runs the churn operations on one container and prints one line for it. Deletes c.
+ *
+ * @param insert inserts a key into the container.
+ */
+template<typename Container, typename Insert>
+void churnRun(const char* name, Container* c, std::vector<int> keys, int m, Insert insert) {
+    int n = keys.size();
+    for(int key : keys)
+        insert(*c, key);
+    WorkloadRandom rng (3);
+    size_t count = allocCount;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++) {
+        //replace a random key by its odd or even neighbour, so the new key is never present
+        int& key = keys[rng.next() % n];
+        c->remove(key);
+        key ^= 1;
+        insert(*c, key);
+    }
+    double churnNs = nsSince(start) / m;
+    double allocs = (double) (allocCount - count) / m;
+
+    start = std::chrono::steady_clock::now();
+    c->clear();
+    double clearMs = nsSince(start) / 1e6;
+    for(int key : keys)
+        insert(*c, key);
+    start = std::chrono::steady_clock::now();
+    delete c;
+    double destroyMs = nsSince(start) / 1e6;
+
+    std::cout << "churn " << name << " n=" << n << " ns/(remove+insert)=" << churnNs << " mallocs/op=" << allocs
+              << " clear ms=" << clearMs << " destroy ms=" << destroyMs << "\n";
+}
+
+/**
+ * @brief Loads n random keys, then does m rounds of removing a random key and inserting a new one,
+ *        on a Skiplist and a ScapegoatTree with the default allocator, a std::pmr::unsynchronized_pool_resource
+ *        and an ArenaAllocator. Then clears the container, refills it and destroys it.
+ *        Prints ns per round, global mallocs per round and ms for clear and for destruction.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of remove + insert rounds.
+ */
+void Churn(int n, int m) {
+    std::vector<int> keys = shuffledKeys(n);
+    auto slInsert = [](auto& list, int key) { list.insert(key, key); };
+    auto sgtInsert = [](auto& tree, int key) { tree.insert(key); };
+    // containers are made in statements of their own, so the default allocator argument does not
+    // outlive the constructor and keep an arena from being exclusive() while churnRun runs.
+    std::pmr::unsynchronized_pool_resource pool;
+    {
+        auto* list = new Skiplist<int, int> (32, 0.5);
+        churnRun("Skiplist new/delete", list, keys, m, slInsert);
+    }
+    {
+        auto* list = new Skiplist<int, int, NoStats, std::less<int>, std::pmr::polymorphic_allocator<char>> (32, 0.5, 0x9E3779B97F4A7C15ULL, {}, &pool);
+        churnRun("Skiplist pmr-pool", list, keys, m, slInsert);
+    }
+    {
+        auto* list = new Skiplist<int, int, NoStats, std::less<int>, ArenaAllocator<char>> (32, 0.5);
+        churnRun("Skiplist arena", list, keys, m, slInsert);
+    }
+    {
+        auto* tree = new ScapegoatTree<int> (0.57);
+        churnRun("ScapegoatTree new/delete", tree, keys, m, sgtInsert);
+    }
+    {
+        auto* tree = new ScapegoatTree<int, void, false, NoStats, std::less<int>, std::pmr::polymorphic_allocator<char>> (0.57, {}, &pool);
+        churnRun("ScapegoatTree pmr-pool", tree, keys, m, sgtInsert);
+    }
+    {
+        auto* tree = new ScapegoatTree<int, void, false, NoStats, std::less<int>, ArenaAllocator<char>> (0.57);
+        churnRun("ScapegoatTree arena", tree, keys, m, sgtInsert);
+    }
+}
+
+/**
+ * @brief Counts the allocations of searches, inserts of keys that are present and removes on one container
+ *          and prints one line for it. Half of the searches and removes are for absent keys.
+ *
+ * @param insert inserts a key into the container.
+ * @param search returns true if the key is in the container.
+ * @return bool true if none of the three allocated.
+ */
+template<typename Container, typename Insert, typename Search>
+bool allocFreeRun(const char* name, Container& c, const std::vector<int>& keys, int m, Insert insert, Search search) {
+    int n = keys.size();
+    m = std::min(m, n);
+    for(int key : keys)
+        insert(c, key);
+    //a round of removes first, so the buffer rebuilds reuse has grown to the size they need
+    for(int i = 0; i < m; i++)
+        c.remove(keys[i]);
+    for(int i = 0; i < m; i++)
+        insert(c, keys[i]);
+
+    //keys are even, key + 1 is never present
+    long found = 0;
+    size_t count = allocCount;
+    for(int i = 0; i < m; i++)
+        found += search(c, keys[i] + (i & 1));
+    size_t searchAllocs = allocCount - count;
+
+    count = allocCount;
+    for(int i = 0; i < m; i++)
+        insert(c, keys[i]);
+    size_t insertAllocs = allocCount - count;
+
+    count = allocCount;
+    for(int i = 0; i < m; i++)
+        found += c.remove(keys[i] + (i & 1)) ? 1 : 0;
+    size_t removeAllocs = allocCount - count;
+
+    bool ok = searchAllocs == 0 && insertAllocs == 0 && removeAllocs == 0;
+    std::cout << "alloc-free " << name << " n=" << n << " m=" << m << " mallocs: search=" << searchAllocs
+              << " insert(present)=" << insertAllocs << " remove=" << removeAllocs << " found=" << found
+              << (ok ? " ok" : " FAILED") << "\n";
+    return ok;
+}
+
+/**
+ * @brief Checks that searches, inserts of keys that are present and removes do not allocate, on a loaded
+ *          Skiplist, UnrolledSkiplist, ScapegoatTree (set, map, with subtree sizes, and with alpha = 0.9 on
+ *          ascending keys, deeper than the path an insert keeps) and FatScapegoatTree.
+ *          Allocations are counted by the global operator new above.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of operations of each kind, at most n.
+ * @return int number of containers with an operation that allocated.
+ */
+int AllocFree(int n, int m) {
+    std::vector<int> keys = shuffledKeys(n);
+    auto slInsert = [](auto& list, int key) { list.insert(key, key); };
+    auto slSearch = [](auto& list, int key) { return list.search(key) != nullptr; };
+    auto sgtInsert = [](auto& tree, int key) { tree.insert(key); };
+    auto sgtSearch = [](auto& tree, int key) { return tree.search_key(key) != nullptr; };
+    int failed = 0;
+    {
+        Skiplist<int, int> list (32, 0.5);
+        failed += !allocFreeRun("Skiplist", list, keys, m, slInsert, slSearch);
+    }
+    {
+        UnrolledSkiplist<int, int> list (32, 0.5);
+        failed += !allocFreeRun("UnrolledSkiplist", list, keys, m, slInsert, slSearch);
+    }
+    {
+        ScapegoatTree<int> tree (0.57);
+        failed += !allocFreeRun("ScapegoatTree", tree, keys, m, sgtInsert, sgtSearch);
+    }
+    {
+        ScapegoatTree<int, int> tree (0.57);
+        failed += !allocFreeRun("ScapegoatTree-map", tree, keys, m,
+            [](auto& tree, int key) { tree.insert_or_assign(key, key); },
+            [](auto& tree, int key) { return tree.find(key) != nullptr; });
+    }
+    {
+        ScapegoatTree<int, void, true> tree (0.57);
+        failed += !allocFreeRun("ScapegoatTree-sizes", tree, keys, m, sgtInsert, sgtSearch);
+    }
+    {
+        std::vector<int> ascending (keys);
+        std::sort(ascending.begin(), ascending.end());
+        ScapegoatTree<int> tree (0.9);
+        failed += !allocFreeRun("ScapegoatTree-deep", tree, ascending, m, sgtInsert, sgtSearch);
+    }
+    {
+        FatScapegoatTree<int> tree (0.57);
+        failed += !allocFreeRun("FatScapegoatTree", tree, keys, m, sgtInsert, sgtSearch);
+    }
+    return failed;
+}
+
+/**
+ * @brief Fills a map of std::unique_ptr<int> values with try_emplace, assigns m of them, tries to emplace
+ *          over present keys and removes half of the assigned ones, then checks every value and prints one line.
+ *
+ * @param emplace try_emplace(key, std::unique_ptr<int>) of the container, must not touch a present key.
+ * @param assign replaces the value of a key with a std::unique_ptr<int>.
+ * @param find returns the container's std::unique_ptr<int>* for a key, null if it is missing.
+ * @return bool true if every value was as expected.
+ */
+template<typename Container, typename Emplace, typename Assign, typename Find>
+bool moveOnlyRun(const char* name, Container& c, const std::vector<int>& keys, int m, Emplace emplace, Assign assign, Find find) {
+    int n = keys.size();
+    m = std::min(m, n);
+    for(int key : keys)
+        emplace(c, key, std::make_unique<int>(key));
+    for(int i = 0; i < m; i++)
+        assign(c, keys[i], std::make_unique<int>(keys[i] + 1));
+    for(int i = 0; i < m; i++)
+        emplace(c, keys[i], std::make_unique<int>(-1));
+    for(int i = 0; i < m; i += 2)
+        c.remove(keys[i]);
+
+    long wrong = 0;
+    for(int i = 0; i < n; i++) {
+        std::unique_ptr<int>* value = find(c, keys[i]);
+        if(i < m && i % 2 == 0)
+            wrong += value != nullptr;
+        else
+            wrong += value == nullptr || *value == nullptr || **value != keys[i] + (i < m);
+    }
+    bool ok = wrong == 0 && c.getSize() == n - (m + 1) / 2;
+    std::cout << "move-only " << name << " n=" << n << " m=" << m << " size=" << c.getSize() << " wrong=" << wrong
+              << (ok ? " ok" : " FAILED") << "\n";
+    return ok;
+}
+
+/**
+ * @brief Checks that Skiplist and ScapegoatTree (with and without subtree sizes) hold std::unique_ptr values:
+ *          the program only compiles if no path copies a value, and moveOnlyRun checks that none is lost.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of assigned keys, at most n.
+ * @return int number of containers with a wrong value.
+ */
+int MoveOnly(int n, int m) {
+    using Value = std::unique_ptr<int>;
+    std::vector<int> keys = shuffledKeys(n);
+    int failed = 0;
+    {
+        Skiplist<int, Value> list (32, 0.5);
+        failed += !moveOnlyRun("Skiplist", list, keys, m,
+            [](auto& list, int key, Value value) { list.emplace(key, std::move(value)); },
+            [](auto& list, int key, Value value) { list.insert(int(key), std::move(value)); },
+            [](auto& list, int key) { return list.search(key); });
+    }
+    auto sgtEmplace = [](auto& tree, int key, Value value) { tree.try_emplace(key, std::move(value)); };
+    auto sgtAssign = [](auto& tree, int key, Value value) { tree.insert_or_assign(key, std::move(value)); };
+    auto sgtFind = [](auto& tree, int key) { return tree.find(key); };
+    {
+        ScapegoatTree<int, Value> tree (0.57);
+        failed += !moveOnlyRun("ScapegoatTree", tree, keys, m, sgtEmplace, sgtAssign, sgtFind);
+    }
+    {
+        ScapegoatTree<int, Value, true> tree (0.57);
+        failed += !moveOnlyRun("ScapegoatTree-sizes", tree, keys, m, sgtEmplace, sgtAssign, sgtFind);
+    }
+    return failed;
+}
+
+/**
+ * @brief Times merge, intersect, subtract, split and join on one structure against per-key loops doing the same,
+ *          each on freshly loaded containers, and prints one line per operation.
+ *
+ * @param a keys of the container operated on, split at a.size().
+ * @param b keys of the other container.
+ * @param make returns a new empty container.
+ * @param insert inserts a key into the container.
+ * @param search returns true if the key is in the container.
+ */
+template<typename Make, typename Insert, typename Search>
+void setOpsRun(const char* name, const std::vector<int>& a, const std::vector<int>& b, Make make, Insert insert, Search search) {
+    using Container = typename std::remove_pointer<decltype(make())>::type;
+    auto load = [&](const std::vector<int>& keys) {
+        std::unique_ptr<Container> c (make());
+        for(int key : keys)
+            insert(*c, key);
+        return c;
+    };
+    auto report = [&](const char* op, double ns, int size, double loopNs, int loopSize) {
+        std::cout << "set-ops " << name << " " << op << " n=" << a.size() << " m=" << b.size()
+                  << " ms=" << ns / 1e6 << " per-key ms=" << loopNs / 1e6 << " size=" << size
+                  << (size == loopSize ? "" : " MISMATCH") << "\n";
+    };
+    int pivot = a.size();
+
+    auto x = load(a), y = load(b);
+    auto start = std::chrono::steady_clock::now();
+    x->merge(*y);
+    double ns = nsSince(start);
+    auto u = load(a);
+    start = std::chrono::steady_clock::now();
+    for(int key : b)
+        insert(*u, key);
+    report("merge", ns, x->getSize(), nsSince(start), u->getSize());
+
+    x = load(a), y = load(b);
+    start = std::chrono::steady_clock::now();
+    x->intersect(*y);
+    ns = nsSince(start);
+    u = load(a);
+    start = std::chrono::steady_clock::now();
+    std::vector<int> absent;
+    for(int key : a)
+        if(!search(*y, key))
+            absent.push_back(key);
+    for(int key : absent)
+        u->remove(key);
+    report("intersect", ns, x->getSize(), nsSince(start), u->getSize());
+
+    x = load(a);
+    start = std::chrono::steady_clock::now();
+    x->subtract(*y);
+    ns = nsSince(start);
+    u = load(a);
+    start = std::chrono::steady_clock::now();
+    for(int key : b)
+        u->remove(key);
+    report("subtract", ns, x->getSize(), nsSince(start), u->getSize());
+
+    x = load(a);
+    std::unique_ptr<Container> greater (make());
+    start = std::chrono::steady_clock::now();
+    x->split(pivot, *greater);
+    ns = nsSince(start);
+    u = load(a);
+    std::unique_ptr<Container> loopGreater (make());
+    start = std::chrono::steady_clock::now();
+    for(int key : a) {
+        if(key >= pivot) {
+            insert(*loopGreater, key);
+            u->remove(key);
+        }
+    }
+    report("split", ns, x->getSize(), nsSince(start), u->getSize());
+
+    start = std::chrono::steady_clock::now();
+    x->join(*greater);
+    ns = nsSince(start);
+    start = std::chrono::steady_clock::now();
+    for(int key : a)
+        if(key >= pivot)
+            insert(*u, key);
+    loopGreater->clear();
+    report("join", ns, x->getSize(), nsSince(start), u->getSize());
+}
+
+/**
+ * @brief Loads n keys (0, 2, 4, ... shuffled) into one container and m random keys from [0, 2n) into another,
+ *          so about half of them are in both, then compares merge, intersect, subtract, split at n and join
+ *          with the loops of single inserts, searches and removes that give the same result,
+ *          on a Skiplist and a ScapegoatTree. Prints ms for both.
+ *
+ * @param n Amount of keys in the container operated on.
+ * @param m Amount of keys in the other container.
+ */
+void SetOps(int n, int m) {
+    std::vector<int> a = shuffledKeys(n);
+    std::vector<int> b (m);
+    WorkloadRandom rng (5);
+    for(int& key : b)
+        key = rng.next() % (2 * n);
+    setOpsRun("Skiplist", a, b, []() { return new Skiplist<int, int> (32, 0.5); },
+        [](auto& list, int key) { list.insert(key, key); },
+        [](auto& list, int key) { return list.search(key) != nullptr; });
+    setOpsRun("ScapegoatTree", a, b, []() { return new ScapegoatTree<int> (0.57); },
+        [](auto& tree, int key) { tree.insert(key); },
+        [](auto& tree, int key) { return tree.search_key(key) != nullptr; });
+}
+
+/**
+ * @brief Inserts n random keys into a scapegoat tree with and without subtree sizes,
+ *        then does m random rank and select queries on the sized one.
+ *        Prints ns per insert for both and ns per rank/select.
+ *
+ * @param n Amount of keys to insert.
+ * @param m Amount of queries.
+ */
+void SGTRank(int n, int m) {
+    std::vector<int> keys (n);
+    std::srand(1);
+    for(int& key : keys)
+        key = std::rand();
+
+    ScapegoatTree<int, void, false, FullStats> plain (0.57);
+    auto start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        plain.insert(key);
+    double plainNs = nsSince(start);
+
+    ScapegoatTree<int, void, true, FullStats> sized (0.57);
+    start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        sized.insert(key);
+    double sizedNs = nsSince(start);
+
+    long sum = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++)
+        sum += sized.rank(std::rand());
+    double rankNs = nsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < m; i++)
+        sum += *sized.select(std::rand() % sized.getSize());
+    double selectNs = nsSince(start);
+
+    std::cout << "SGT-rank n=" << sized.getSize()
+              << " ns/insert=" << plainNs / n
+              << " ns/insert(sizes)=" << sizedNs / n
+              << " ns/rank=" << rankNs / m
+              << " ns/select=" << selectNs / m
+              << " restructs=" << plain.stats().rebuilds << "/" << sized.stats().rebuilds
+              << " checksum=" << sum << "\n";
+}
+
+/**
+ * @brief Inserts n random keys into a scapegoat tree and does m random searches,
+ *        on the live tree and on a frozen snapshot of it. Prints ns per search for both.
+ *
+ * @param n Amount of keys to insert.
+ * @param m Amount of searches.
+ */
+void SGTFrozen(int n, int m) {
+    std::srand(1);
+    ScapegoatTree<int> tree (0.57);
+    for(int j = 0; j < n; j++)
+        tree.insert(std::rand() % (2 * n));
+    std::vector<int> queries (m);
+    for(int i = 0; i < m; i++)
+        queries[i] = std::rand() % (2 * n);
+
+    int found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int q : queries)
+        found += tree.search_key(q) != nullptr;
+    double treeNs = nsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    FrozenTree<int> frozen = tree.freeze();
+    double freezeNs = nsSince(start);
+
+    int frozenFound = 0;
+    start = std::chrono::steady_clock::now();
+    for(int q : queries)
+        frozenFound += frozen.search_key(q) != nullptr;
+    double frozenNs = nsSince(start);
+
+    long sum = 0;
+    start = std::chrono::steady_clock::now();
+    for(int q : queries) {
+        const int* k = frozen.lower_bound(q);
+        sum += k ? *k : 0;
+    }
+    double lowerNs = nsSince(start);
+
+    std::cout << "SGT-frozen n=" << tree.getSize()
+              << " tree ns/search=" << treeNs / m
+              << " frozen ns/search=" << frozenNs / m
+              << " frozen ns/lower_bound=" << lowerNs / m
+              << " freeze ms=" << freezeNs / 1e6
+              << " found=" << found << "/" << frozenFound << " sum=" << sum << "\n";
+}
+
+/**
+ * @brief Loads n sorted keys into a scapegoat tree with inserts and with bulk_load, then adds a sorted batch
+ *        of m random keys with inserts and with insert_batch. Prints the time of each.
+ *
+ * @param n Amount of keys to load.
+ * @param m Size of the batch.
+ */
+void SGTBatch(int n, int m) {
+    std::srand(1);
+    std::vector<int> keys (n), batch (m);
+    for(int& k : keys)
+        k = std::rand();
+    for(int& k : batch)
+        k = std::rand();
+    std::sort(keys.begin(), keys.end());
+    std::sort(batch.begin(), batch.end());
+
+    ScapegoatTree<int> inserted (0.57);
+    auto start = std::chrono::steady_clock::now();
+    for(int k : keys)
+        inserted.insert(k);
+    double insertNs = nsSince(start);
+
+    ScapegoatTree<int> loaded (0.57);
+    start = std::chrono::steady_clock::now();
+    loaded.bulk_load(keys.begin(), keys.end());
+    double loadNs = nsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for(int k : batch)
+        inserted.insert(k);
+    double batchInsertNs = nsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    loaded.insert_batch(batch.begin(), batch.end());
+    double batchNs = nsSince(start);
+
+    std::cout << "SGT-batch n=" << n << " m=" << m
+              << " load: inserts ms=" << insertNs / 1e6 << " bulk_load ms=" << loadNs / 1e6
+              << " batch: inserts ms=" << batchInsertNs / 1e6 << " insert_batch ms=" << batchNs / 1e6
+              << " size=" << inserted.getSize() << "/" << loaded.getSize() << "\n";
+}
+
+/**
+ * @brief Loads the same n random keys into a skiplist and a scapegoat tree and does m range scans
+ *        of about k keys each on both. Prints ns per scan and per key visited.
+ *
+ * @param n Amount of keys, drawn from [0, 4n).
+ * @param m Amount of scans.
+ * @param k Expected keys per scan.
+ */
+void RangeScan(int n, int m, int k) {
+    std::srand(1);
+    std::vector<std::pair<int, int>> pairs (n);
+    for(auto& p : pairs)
+        p = {std::rand() % (4 * n), 0};
+    Skiplist<int, int> list (32, 0.5);
+    list.bulk_load_unsorted(pairs.begin(), pairs.end());
+    std::vector<int> keys;
+    for(auto& e : list)
+        keys.push_back(e.key);
+    ScapegoatTree<int> tree (keys.begin(), keys.end(), 0.57);
+
+    int width = (long) k * 4 * n / list.getSize();
+    std::vector<int> lows (m);
+    for(int& lo : lows)
+        lo = std::rand() % (4 * n);
+
+    long visited = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int lo : lows)
+        for(auto& e : list.range(lo, lo + width))
+            visited += e.data + 1;
+    double listNs = nsSince(start);
+
+    long treeVisited = 0;
+    start = std::chrono::steady_clock::now();
+    for(int lo : lows)
+        for(int key : tree.range(lo, lo + width))
+            treeVisited += key >= 0;
+    double treeNs = nsSince(start);
+
+    std::cout << "range n=" << list.getSize() << " keys/scan=" << (double) visited / m
+              << " SL ns/scan=" << listNs / m << " ns/key=" << listNs / visited
+              << " SGT ns/scan=" << treeNs / m << " ns/key=" << treeNs / treeVisited << "\n";
+}
+
+/**
+ * @brief Loads n random keys into a concurrent skiplist, then runs m operations split over
+ *        1, 2, 4, ... up to all hardware threads. reads percent of the operations are searches,
+ *        the rest are inserts and removes in equal parts. Prints throughput per thread count.
+ *
+ * @param n Amount of keys to load, keys are drawn from [0, 2n).
+ * @param m Amount of operations per thread count.
+ * @param reads Percentage of searches.
+ */
+void CSListThreads(int n, int m, int reads) {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for(int t = 1; t < cores; t *= 2)
+        counts.push_back(t);
+    counts.push_back(cores);
+
+    for(int threads : counts) {
+        ConcurrentSkiplist<int, int> list (32, 0.5);
+        std::srand(1);
+        for(int j = 0; j < n; j++)
+            list.insert(std::rand() % (2 * n), j);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for(int t = 0; t < threads; t++) {
+            workers.emplace_back([&list, n, m, reads, threads, t]() {
+                uint64_t x = 0x9E3779B97F4A7C15ULL * (t + 1);
+                for(int i = 0; i < m / threads; i++) {
+                    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                    int key = x % (2 * n);
+                    int op = (x >> 32) % 100;
+                    if(op < reads)
+                        list.search(key);
+                    else if(op % 2 == 0)
+                        list.insert(key, i);
+                    else
+                        list.remove(key);
+                }
+            });
+        }
+        for(std::thread& w : workers)
+            w.join();
+        double ns = nsSince(start);
+
+        std::cout << "CSL-threads threads=" << threads << " reads=" << reads << "%"
+                  << " Mops/s=" << (double) (m / threads * threads) / (ns / 1e3)
+                  << " size=" << list.getSize() << "\n";
+    }
+}
+
+/**
+ * @brief Loads n random keys into a concurrent scapegoat tree. Then 1, 2, 4, ... up to all hardware threads
+ *        run m searches in total while one more thread keeps inserting and removing random keys.
+ *        Prints read throughput, writer throughput and rebuilds per reader count.
+ *
+ * @param n Amount of keys to load, keys are drawn from [0, 2n).
+ * @param m Amount of searches per reader count.
+ */
+void CSGTReaders(int n, int m) {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for(int t = 1; t < cores; t *= 2)
+        counts.push_back(t);
+    counts.push_back(cores);
+
+    for(int readers : counts) {
+        ConcurrentScapegoatTree<int, ConcurrentStats> tree (0.57);
+        std::srand(1);
+        for(int j = 0; j < n; j++)
+            tree.insert(std::rand() % (2 * n));
+        long restructs = tree.stats().rebuilds;
+
+        std::atomic<bool> done {false};
+        long writes = 0;
+        std::thread writer ([&tree, &done, &writes, n]() {
+            uint64_t x = 0x2545F4914F6CDD1DULL;
+            while(!done.load()) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                int key = x % (2 * n);
+                if(x >> 63)
+                    tree.insert(key);
+                else
+                    tree.remove(key);
+                writes++;
+            }
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for(int t = 0; t < readers; t++) {
+            workers.emplace_back([&tree, n, m, readers, t]() {
+                uint64_t x = 0x9E3779B97F4A7C15ULL * (t + 1);
+                for(int i = 0; i < m / readers; i++) {
+                    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                    tree.search_key(x % (2 * n));
+                }
+            });
+        }
+        for(std::thread& w : workers)
+            w.join();
+        double ns = nsSince(start);
+        done.store(true);
+        writer.join();
+
+        std::cout << "CSGT-readers readers=" << readers
+                  << " read Mops/s=" << (double) (m / readers * readers) / (ns / 1e3)
+                  << " write Mops/s=" << (double) writes / (ns / 1e3)
+                  << " rebuilds=" << tree.stats().rebuilds - restructs << "\n";
+    }
+}
+
+/**
+ * @brief Runs the same preload of n keys and m operations on Skiplist, ScapegoatTree, std::map and std::set.
+ *        Prints one line per structure and distribution and optionally writes all results to a file.
+ *
+ * @param n Amount of keys to preload, keys are drawn from [0, 2n).
+ * @param m Amount of operations.
+ * @param reads Percentage of searches, the rest are inserts and removes in equal parts.
+ * @param distribution uniform, zipf, sequential or all.
+ * @param path CSV file, or JSON if it ends in .json. Null to only print.
+ */
+void WorkloadBench(int n, int m, int reads, const char* distribution, const char* path) {
+    std::vector<std::string> distributions;
+    if(strcmp(distribution, "all") == 0)
+        distributions = {"uniform", "zipf", "sequential"};
+    else
+        distributions = {distribution};
+
+    std::vector<WorkloadResult> results;
+    for(const std::string& d : distributions) {
+        Workload w (d, n, m, reads);
+        results.push_back(measure<SListAdapter>(w));
+        results.push_back(measure<UnrolledAdapter>(w));
+        results.push_back(measure<MapAdapter>(w));
+        results.push_back(measure<SGTAdapter>(w));
+        results.push_back(measure<SGTIncrementalAdapter>(w));
+        results.push_back(measure<FatSGTAdapter>(w));
+        results.push_back(measure<SetAdapter>(w));
+    }
+
+    for(const WorkloadResult& r : results) {
+        std::cout << "workload " << r.structure << " " << r.distribution << " n=" << r.n << " reads=" << r.reads << "%"
+                  << " ns/op=" << r.nsPerOp << " p50=" << r.p50 << " p99=" << r.p99 << " p999=" << r.p999 << " max=" << r.max
+                  << " allocs/op=" << r.allocsPerOp;
+        if(r.compsPerSearch >= 0)
+            std::cout << " comps/search=" << r.compsPerSearch;
+        if(r.rebuilds >= 0)
+            std::cout << " rebuilds=" << r.rebuilds;
+        std::cout << "\n";
+    }
+    if(path && !writeResults(results, path))
+        std::cout << "could not write " << path << "\n";
+}
+
+/**
+ * @brief Does m searches for random keys from [0, 2n) with search.
+ *
+ * @param search returns true if the key was found.
+ * @param found incremented per key found, so the searches can not be optimized away.
+ * @return double ns per search.
+ */
+template<typename Search>
+double searchNs(Search search, int n, int m, long& found) {
+    std::srand(2);
+    std::vector<int> keys (m);
+    for(int& key : keys)
+        key = std::rand() % (2 * n);
+    auto start = std::chrono::steady_clock::now();
+    for(int key : keys)
+        found += search(key);
+    return nsSince(start) / m;
+}
+
+/**
+ * @brief Loads the same n random keys into a skiplist and a scapegoat tree, once with NoStats and once with FullStats,
+ *        and does m random searches on each. Prints ns per search for both policies and the FullStats snapshots.
+ *
+ * @param n Amount of keys, drawn from [0, 2n).
+ * @param m Amount of searches.
+ */
+void StatsOverhead(int n, int m) {
+    std::srand(1);
+    std::vector<int> keys (n);
+    for(int& key : keys)
+        key = std::rand() % (2 * n);
+
+    Skiplist<int, int> list (32, 0.5);
+    Skiplist<int, int, FullStats> countedList (32, 0.5);
+    ScapegoatTree<int> tree (0.57);
+    ScapegoatTree<int, void, false, FullStats> countedTree (0.57);
+    for(int key : keys) {
+        list.insert(key, key);
+        countedList.insert(key, key);
+        tree.insert(key);
+        countedTree.insert(key);
+    }
+
+    long found = 0;
+    double plain = searchNs([&](int key) { return list.search(key) != nullptr; }, n, m, found);
+    double counted = searchNs([&](int key) { return countedList.search(key) != nullptr; }, n, m, found);
+    std::cout << "stats SL ns/search NoStats=" << plain << " FullStats=" << counted << "\n";
+    plain = searchNs([&](int key) { return tree.search_key(key) != nullptr; }, n, m, found);
+    counted = searchNs([&](int key) { return countedTree.search_key(key) != nullptr; }, n, m, found);
+    std::cout << "stats SGT ns/search NoStats=" << plain << " FullStats=" << counted << " found=" << found << "\n";
+
+    Stats s = countedList.stats();
+    std::cout << "SL size=" << s.size << " inserts=" << s.inserts << " searches=" << s.searches
+              << " comps/search=" << (double) s.comparisons / s.searches << " height=" << s.height << " levels=";
+    for(long l : s.levels)
+        std::cout << l << " ";
+    s = countedTree.stats();
+    std::cout << "\nSGT size=" << s.size << " inserts=" << s.inserts << " searches=" << s.searches
+              << " comps/search=" << (double) s.comparisons / s.searches << " height=" << s.height
+              << " rebuilds=" << s.rebuilds << " rebuilt nodes=" << s.rebuiltNodes << " rebuild ms=" << s.rebuildNs / 1e6
+              << "\n    rebuild sizes (2^b nodes: count)";
+    for(int b = 0; b < Stats::BUCKETS; b++)
+        if(s.rebuildSizes[b])
+            std::cout << " " << b << ":" << s.rebuildSizes[b];
+    std::cout << "\n    rebuild times (2^b ns: count)";
+    for(int b = 0; b < Stats::BUCKETS; b++)
+        if(s.rebuildTimes[b])
+            std::cout << " " << b << ":" << s.rebuildTimes[b];
+    std::cout << "\n";
+}
+
+/**
+ * @brief Random permutation of the keys 0, 2, 4, ..., 2n - 2.
+ */
+std::vector<int> shuffledKeys(int n) {
+    std::vector<int> keys (n);
+    for(int j = 0; j < n; j++)
+        keys[j] = 2 * j;
+    WorkloadRandom rng (1);
+    Workload::shuffle(keys, rng);
+    return keys;
+}
+
+/**
+ * @brief Saves a skiplist of n keys and restores it with and without the stored levels.
+ *        For comparison, builds the same list from m random order inserts. Prints ms for each and the file size.
+ *        The file was just written, so restores read it from the page cache.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of keys to insert for the comparison, 0 to skip it.
+ */
+void SListSnapshot(int n, int m) {
+    const char* path = "/tmp/bench-skiplist.snapshot";
+    double saveMs, loadMs, noLevelsMs, insertMs = 0;
+    {
+        std::vector<std::pair<int, int>> pairs (n);
+        for(int j = 0; j < n; j++)
+            pairs[j] = {2 * j, j};
+        Skiplist<int, int> list (32, 0.5);
+        list.bulk_load(pairs.begin(), pairs.end());
+        auto start = std::chrono::steady_clock::now();
+        list.save(path);
+        saveMs = nsSince(start) / 1e6;
+    }
+    {
+        Skiplist<int, int> list (32, 0.5);
+        auto start = std::chrono::steady_clock::now();
+        int r = list.load(path);
+        loadMs = nsSince(start) / 1e6;
+        if(r != 0 || list.getSize() != n)
+            std::cout << "load failed: " << r << "\n";
+        list.save(path, false);
+    }
+    {
+        Skiplist<int, int> list (32, 0.5);
+        auto start = std::chrono::steady_clock::now();
+        list.load(path);
+        noLevelsMs = nsSince(start) / 1e6;
+    }
+    if(m > 0) {
+        std::vector<int> keys = shuffledKeys(m);
+        Skiplist<int, int> list (32, 0.5);
+        auto start = std::chrono::steady_clock::now();
+        for(int key : keys)
+            list.insert(key, key);
+        insertMs = nsSince(start) / 1e6;
+    }
+    struct stat st;
+    stat(path, &st);
+    std::cout << "SL-snapshot n=" << n << " save ms=" << saveMs << " load ms=" << loadMs
+              << " load without levels ms=" << noLevelsMs << " file bytes=" << st.st_size;
+    if(m > 0)
+        std::cout << " inserts of " << m << " keys ms=" << insertMs;
+    std::cout << "\n";
+    unlink(path);
+}
+
+/**
+ * @brief Saves a scapegoat tree of n keys and restores it. For comparison, builds the same tree from m random order inserts.
+ *        Prints ms for each and the file size. The file was just written, so the restore reads it from the page cache.
+ *
+ * @param n Amount of keys.
+ * @param m Amount of keys to insert for the comparison, 0 to skip it.
+ */
+void SGTSnapshot(int n, int m) {
+    const char* path = "/tmp/bench-scapegoat.snapshot";
+    double saveMs, loadMs, insertMs = 0;
+    {
+        std::vector<int> keys (n);
+        for(int j = 0; j < n; j++)
+            keys[j] = 2 * j;
+        ScapegoatTree<int> tree (keys.begin(), keys.end(), 0.57);
+        keys = std::vector<int>();
+        auto start = std::chrono::steady_clock::now();
+        tree.save(path);
+        saveMs = nsSince(start) / 1e6;
+    }
+    {
+        ScapegoatTree<int> tree (0.57);
+        auto start = std::chrono::steady_clock::now();
+        int r = tree.load(path);
+        loadMs = nsSince(start) / 1e6;
+        if(r != 0 || tree.getSize() != n)
+            std::cout << "load failed: " << r << "\n";
+    }
+    if(m > 0) {
+        std::vector<int> keys = shuffledKeys(m);
+        ScapegoatTree<int> tree (0.57);
+        auto start = std::chrono::steady_clock::now();
+        for(int key : keys)
+            tree.insert(key);
+        insertMs = nsSince(start) / 1e6;
+    }
+    struct stat st;
+    stat(path, &st);
+    std::cout << "SGT-snapshot n=" << n << " save ms=" << saveMs << " load ms=" << loadMs << " file bytes=" << st.st_size;
+    if(m > 0)
+        std::cout << " inserts of " << m << " keys ms=" << insertMs;
+    std::cout << "\n";
+    unlink(path);
+}
+
+/**
+ * @brief Runs m operations on a Sharded container preloaded with n random keys from [0, 2n), split over the threads.
+ *
+ * @param shards Amount of shards, boundaries split the key space evenly.
+ * @param args constructor arguments of each shard's container.
+ * @return double Mops/s.
+ */
+template<typename Container, typename... Args>
+double shardedMops(int shards, int threads, int n, int m, int reads, Args... args) {
+    Sharded<Container> sharded (Sharded<Container>::even(shards, 0, 2 * n), args...);
+    uint64_t x = 0x2545F4914F6CDD1DULL;
+    for(int j = 0; j < n; j++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        sharded.insert(x % (2 * n), j);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++) {
+        workers.emplace_back([&sharded, n, m, reads, threads, t]() {
+            uint64_t x = 0x9E3779B97F4A7C15ULL * (t + 1);
+            for(int i = 0; i < m / threads; i++) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                int key = x % (2 * n);
+                int op = (x >> 32) % 100;
+                if(op < reads)
+                    sharded.search(key);
+                else if(op % 2 == 0)
+                    sharded.insert(key, i);
+                else
+                    sharded.remove(key);
+            }
+        });
+    }
+    for(std::thread& w : workers)
+        w.join();
+    return (double) (m / threads * threads) / (nsSince(start) / 1e3);
+}
+
+/**
+ * @brief Compares one locked container with a range-sharded one for 1, 2, 4, ... up to all cores.
+ *        The sharded variants get 4 shards per core, at least 16. Prints Mops/s per structure, shard count and thread count.
+ *
+ * @param n Amount of keys to preload, keys are drawn from [0, 2n).
+ * @param m Amount of operations per run.
+ * @param reads Percentage of searches, the rest are inserts and removes in equal parts.
+ */
+void ShardedThreads(int n, int m, int reads) {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for(int t = 1; t < cores; t *= 2)
+        counts.push_back(t);
+    counts.push_back(cores);
+
+    for(int shards : {1, std::max(16, 4 * cores)}) {
+        for(int threads : counts) {
+            std::cout << "sharded Skiplist shards=" << shards << " threads=" << threads << " reads=" << reads << "%"
+                      << " Mops/s=" << shardedMops<Skiplist<int, int>>(shards, threads, n, m, reads, 32, 0.5) << "\n";
+            std::cout << "sharded ScapegoatTree shards=" << shards << " threads=" << threads << " reads=" << reads << "%"
+                      << " Mops/s=" << shardedMops<ScapegoatTree<int, int>>(shards, threads, n, m, reads, 0.57) << "\n";
+        }
+    }
+}
@@ -5,17 +5,15 @@
 #include <string.h>
 
 #include "SkipList.cpp"
+#include "UnrolledSkipList.cpp"
 #include "ScapegoatTree.cpp"
+#include "Commands.cpp"
 
-template<typename K, typename V>
-void SList(Skiplist<K, V>& list);
+template<typename List>
+void SList(List& list);
 template<typename K>
 void SGtree(ScapegoatTree<K>& tree);
-template<typename K, typename V>
-void SListAnalysis(Skiplist<K, V>& list, int n);
-template<typename K>
-void SGTAnalysis(ScapegoatTree<K>& tree, int n);
-std::vector<std::string> tokenize(std::string s, std::string del);
+void Record();
 
 int main(int argc, char **argv) {
     if(argc == 1) {
@@ -26,22 +24,20 @@ int main(int argc, char **argv) {
     if(strcmp(argv[1], "SL") == 0) {
         if(argc == 2) { //Skiplist int, int, 32 default
             Skiplist<int, int> list (32);
-            SList<int, int>(list);
+            SList(list);
         } else if(argc == 3) {
             Skiplist<int, int> list (32, atof(argv[2]));
-            SList<int, int>(list);
-        } else if(argc > 4) {
-            Skiplist<int, int> list (32, 0.5);
-            //insert n elements
-            for(int j = 0; j < atoi(argv[2]); j++) {
-                list.insert(j, 1);
-            }   
-            for(int i = 0; i < atoi(argv[3]); i++) {
-                list.resetComps();
-                SListAnalysis<int, int>(list, atoi(argv[2]));     
-            }
+            SList(list);
         }
     }
+    //Unrolled skiplist commands, same as SL
+    if(strcmp(argv[1], "USL") == 0) {
+        UnrolledSkiplist<int, int> list (32, argc == 3 ? atof(argv[2]) : 0.5);
+        SList(list);
+    }
+    //Convert a text trace to binary
+    if(strcmp(argv[1], "record") == 0)
+        Record();
     //Scapegoat tree commands
     if(strcmp(argv[1], "SGT") == 0) {
         if(argc == 2) { //ScapegoatTree int
@@ -50,160 +46,103 @@ int main(int argc, char **argv) {
         } else if (argc == 3) {
             ScapegoatTree<int> tree (atof(argv[2]));
             SGtree<int>(tree);
-        } else if(argc > 4) {
-            ScapegoatTree<int> tree (0.60);   
-            for(int j = 0; j < atoi(argv[2]); j++) {
-                tree.insert((int) (((double) std::rand() / (RAND_MAX)) * atoi(argv[2])));
-            }
-            for(int i = 0; i < atoi(argv[3]); i++) {
-                SGTAnalysis(tree, atoi(argv[2]));
-                tree.resetComps();
-            }
         }
     }
     std::cout << std::flush;
 }
 
 /**
- * @brief Used to search for random nodes in the scapegoat tree. Prints information about the size, 
- *        number of comparisons and amount of rebuilds the tree has gone through.
- * 
- * @tparam K 
- * @param tree Scapegoat tree object reference.
- * @param n  Amount of nodes in the scapegoat tree.
- */
-template<typename K>
-void SGTAnalysis(ScapegoatTree<K>& tree, int n) {
-    auto s1 = (int) (((double) std::rand() / (RAND_MAX)) * n);
-    tree.search_key(s1);
-    std::cout << "Tree size: " << n << " - Searching for: " << s1 << " - Comparisons: " << tree.getComps() << " - Restructs: " << tree.getRestructs() << std::endl;
-    std::cout << std::flush;
-}
-
-/**
- * @brief Used to find random elements in the skip list. Prints information about size
- *         and number of comparisons.
- * 
- * @tparam K 
- * @tparam V 
- * @param list Skiplist object reference.
- * @param n Amount of elements in the list.
- */
-template<typename K, typename V>
-void SListAnalysis(Skiplist<K, V> &list, int n) {
-    auto s1 = (int) (((double) std::rand() / (RAND_MAX)) * n);
-    list.search(s1);
-    std::cout << "List size: " << n << " - Searching for: " << s1 << " - Comparisons: " << list.getComps() << std::endl;
-    std::cout << std::flush;
-}
-
-/**
- * @brief Takes the stdin/cin and tokenizes the lines so the correct operation is
- *         carried out on the data structure. 
- *         Each operation returns an int which indicates the result. The result is printed to stdout/cout.
+ * @brief Reads I/D/S commands from stdin, text or binary (see CommandReader), and carries them out on the tree.
+ *         Each operation returns an int which indicates the result. The result is written to stdout through one buffer.
  *         Lastly the whole tree is printed using the 'pretty_printing' function.
  * @tparam K 
  * @param tree Scapegoat tree object reference.
  */
 template<typename K>
 void SGtree(ScapegoatTree<K>& tree) {
-    for (std::string line; std::getline(std::cin, line);) { // parse each line
-        std::vector<std::string> command = tokenize(line, " ");
-        int key = std::stoi(command.at(1));
-
-        if(command.at(0) == "I") { // Inserting
-            int f = tree.insert(key);
+    CommandReader in (0);
+    OutputBuffer out (1);
+    for(Command c; in.next(c);) {
+        if(c.op == 'I') { // Inserting
+            int f = tree.insert(c.key);
             if(f == 1)
-                std::cout << "S" << std::endl;
+                out.put("S\n");
             else if (f == -1)
-                std::cout << "F - Duplicate key" << std::endl;
+                out.put("F - Duplicate key\n");
             else 
-                std::cout << "F - Could not insert key" << std::endl;
+                out.put("F - Could not insert key\n");
         }
-        if(command.at(0) == "D") { // Deleting
-            int f = tree.remove(key);
+        if(c.op == 'D') { // Deleting
+            int f = tree.remove(c.key);
             if(f == 1)
-                std::cout << "S" << std::endl;
+                out.put("S\n");
             else 
-                std::cout << "F - Key not found" << std::endl;
+                out.put("F - Key not found\n");
         }
-        if(command.at(0) == "S") { // Searching
-            K* v = tree.search_key(key);
+        if(c.op == 'S') { // Searching
+            K* v = tree.search_key(c.key);
             if(v)
-                std::cout << "S" << std::endl;
+                out.put("S\n");
             else 
-                std::cout << "F - Key not found" << std::endl;
+                out.put("F - Key not found\n");
         }
-        std::cout << std::flush;
     }
+    out.flush();
 
     std::cout << "\n";
     tree.pretty_print();
 }
 
 /**
- * @brief Takes the stdin/cin and tokenizes the lines so the correct operation is
- *         carried out on the data structure.
- *         Each operation returns an int which indicates the result. The result is printed to stdout/cout.
+ * @brief Reads I/D/S commands from stdin, text or binary (see CommandReader), and carries them out on the list.
+ *         Each operation returns an int which indicates the result. The result is written to stdout through one buffer.
  *         Lastly the whole list is printed using the 'print_keys_only' function.
  * 
- * @tparam K 
- * @tparam V 
- * @param list Skiplist object reference.
+ * @tparam List Skiplist<int, int> or UnrolledSkiplist<int, int>.
+ * @param list list object reference.
  */
-template<typename K, typename V>
-void SList(Skiplist<K, V>& list) {
-    for (std::string line; std::getline(std::cin, line);) { // parse each line
-        std::vector<std::string> command = tokenize(line, " ");
-        int key = std::stoi(command.at(1));
-
-        if(command.at(0) == "I") { // Inserting
-            int f = list.insert(key, 1);
+template<typename List>
+void SList(List& list) {
+    CommandReader in (0);
+    OutputBuffer out (1);
+    for(Command c; in.next(c);) {
+        if(c.op == 'I') { // Inserting
+            int f = list.insert(c.key, 1);
             if(f == 0)
-                std::cout << "S" << std::endl;
+                out.put("S\n");
             else if (f == 1)
-                std::cout << "F - Duplicate key" << std::endl;
+                out.put("F - Duplicate key\n");
             else 
-                std::cout << "F - Could not insert key" << std::endl;
+                out.put("F - Could not insert key\n");
         }
-        if(command.at(0) == "D") { // Deleting
-            bool f = list.remove(key);
+        if(c.op == 'D') { // Deleting
+            bool f = list.remove(c.key);
             if(f)
-                std::cout << "S" << std::endl;
+                out.put("S\n");
             else 
-                std::cout << "F - Key not found" << std::endl;
+                out.put("F - Key not found\n");
         }
-        if(command.at(0) == "S") { // Searching
-            V* v = list.search(key);
+        if(c.op == 'S') { // Searching
+            auto* v = list.search(c.key);
             if(v)
-                std::cout << "S" << std::endl;
+                out.put("S\n");
             else 
-                std::cout << "F - Key not found" << std::endl;
+                out.put("F - Key not found\n");
         }
-        std::cout << std::flush;
     }
+    out.flush();
 
     std::cout << "\n";
     list.print_keys_only();
 }
 
 /**
- * @brief Tokenizes the input string using the delimiter.
- * 
- * @param s String to tokenize.
- * @param del Delimiter.
- * @return std::vector<std::string> An array of string tokens.
+ * @brief Converts text commands from stdin into the binary trace format on stdout.
  */
-std::vector<std::string> tokenize(std::string s, std::string del)
-{
-    std::vector<std::string> res;
-    int start = 0;
-    int end = s.find(del);
-    while (end != -1) {
-        res.push_back(s.substr(start, end - start));
-        start = end + del.size();
-        end = s.find(del, start);
-    }
-    res.push_back(s.substr(start, end - start));
-    return res;
-}
\ No newline at end of file
+void Record() {
+    CommandReader in (0);
+    OutputBuffer out (1);
+    out.put(CommandReader::MAGIC, sizeof(CommandReader::MAGIC) - 1);
+    for(Command c; in.next(c);)
+        putRecord(out, c);
+}